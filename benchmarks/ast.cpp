@@ -0,0 +1,143 @@
+// Measures lexing, parsing and walking the ast of a big generated program.
+// The walk reads the fields every pass reads from every node (the kind,
+// the location and the type), so it shows how the layout of the nodes
+// affects the passes over the ast.
+//
+//     benchmarks/ast [number of functions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../src/lexer.hpp"
+#include "../src/parser.hpp"
+#include "../src/ast.hpp"
+
+// Program
+// -------
+static std::string generate_program(size_t functions) {
+    std::string program;
+    for (size_t i = 0; i < functions; i++) {
+        std::string n = std::to_string(i);
+        program +=
+            "function f" + n + "(a: Int64, b: Int64): Int64\n"
+            "    x = a + b * " + n + "\n"
+            "    y = x\n"
+            "    while y > 100\n"
+            "        y := y / 2\n"
+            "    if x > 10 and y < 5\n"
+            "        return x - y + f" + n + "(a, b - 1)\n"
+            "    else\n"
+            "        return y\n"
+            "\n";
+    }
+    for (size_t i = 0; i < functions; i++) {
+        program += "print(f" + std::to_string(i) + "(1, 2))\n";
+    }
+    return program;
+}
+
+// Walk
+// ----
+struct Walk {
+    size_t nodes = 0;
+    uint64_t checksum = 0;
+
+    void visit(ast::Node* node) {
+        this->nodes++;
+        this->checksum += node->index();
+        std::visit([this](auto& variant) {
+            this->checksum += variant.line + variant.column + variant.type.type.index();
+            this->visit_children(variant);
+        }, *node);
+    }
+    template <class T> void visit(T* node) {if (node) this->visit((ast::Node*) node);}
+    template <class T> void visit(std::optional<T*> node) {if (node.has_value()) this->visit(node.value());}
+    template <class T> void visit(const std::vector<T*>& nodes) {for (auto node: nodes) this->visit(node);}
+
+    void visit_children(ast::BlockNode& node) {this->visit(node.functions); this->visit(node.types); this->visit(node.statements);}
+    void visit_children(ast::FunctionArgumentNode& node) {this->visit(node.identifier);}
+    void visit_children(ast::FunctionNode& node) {this->visit(node.identifier); this->visit(node.args); this->visit(node.body);}
+    void visit_children(ast::InterfaceNode& node) {this->visit(node.identifier); this->visit(node.args);}
+    void visit_children(ast::TypeNode& node) {this->visit(node.identifier); this->visit(node.fields);}
+    void visit_children(ast::DeclarationNode& node) {this->visit(node.identifier); this->visit(node.expression);}
+    void visit_children(ast::AssignmentNode& node) {this->visit(node.assignable); this->visit(node.expression);}
+    void visit_children(ast::ReturnNode& node) {this->visit(node.expression);}
+    void visit_children(ast::BreakNode& node) {}
+    void visit_children(ast::ContinueNode& node) {}
+    void visit_children(ast::IfElseNode& node) {this->visit(node.condition); this->visit(node.if_branch); this->visit(node.else_branch);}
+    void visit_children(ast::WhileNode& node) {this->visit(node.condition); this->visit(node.block);}
+    void visit_children(ast::UseNode& node) {this->visit(node.path);}
+    void visit_children(ast::LinkWithNode& node) {this->visit(node.directives);}
+    void visit_children(ast::CallArgumentNode& node) {this->visit(node.identifier); this->visit(node.expression);}
+    void visit_children(ast::CallNode& node) {this->visit(node.identifier); this->visit(node.args);}
+    void visit_children(ast::StructLiteralNode& node) {for (auto& field: node.fields) {this->visit(field.first); this->visit(field.second);}}
+    void visit_children(ast::FloatNode& node) {}
+    void visit_children(ast::IntegerNode& node) {}
+    void visit_children(ast::IdentifierNode& node) {}
+    void visit_children(ast::BooleanNode& node) {}
+    void visit_children(ast::StringNode& node) {}
+    void visit_children(ast::InterpolatedStringNode& node) {this->visit(node.expressions);}
+    void visit_children(ast::ArrayNode& node) {this->visit(node.elements);}
+    void visit_children(ast::FieldAccessNode& node) {this->visit(node.accessed); this->visit(node.fields_accessed);}
+    void visit_children(ast::AddressOfNode& node) {this->visit(node.expression);}
+    void visit_children(ast::DereferenceNode& node) {this->visit(node.expression);}
+    void visit_children(ast::NewNode& node) {this->visit(node.expression);}
+};
+
+// Measuring
+// ---------
+// Best of a few runs, in milliseconds
+template <class F>
+static double measure(size_t runs, F f) {
+    double best = 1e300;
+    for (size_t i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t functions = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+    // The parser wants a file it can find
+    auto file = std::filesystem::temp_directory_path() / "diamond-ast-benchmark.dmd";
+    std::string program = generate_program(functions);
+    std::ofstream(file, std::ios::binary) << program;
+
+    token::Tokens tokens;
+    double lex_time = measure(5, [&] {
+        auto result = lexer::lex(program, file);
+        if (result.is_error()) exit(EXIT_FAILURE);
+        tokens = std::move(result.get_value());
+    });
+
+    ast::Ast ast;
+    double parse_time = measure(1, [&] {
+        auto result = parse::program(tokens, file);
+        if (result.is_error()) exit(EXIT_FAILURE);
+        ast = result.get_value();
+    });
+
+    Walk walk;
+    double walk_time = measure(20, [&] {
+        walk = Walk {};
+        walk.visit((ast::Node*) ast.program);
+    });
+
+    std::filesystem::remove(file);
+
+    printf("functions      %zu\n", functions);
+    printf("tokens         %zu (%zu bytes each)\n", tokens.size(), sizeof(token::Token));
+    printf("nodes          %zu (%zu bytes each)\n", walk.nodes, sizeof(ast::Node));
+    printf("lex            %.2f ms\n", lex_time);
+    printf("parse          %.2f ms\n", parse_time);
+    printf("walk           %.2f ms (%.1f ns per node, checksum %llu)\n", walk_time, walk_time * 1e6 / walk.nodes, (unsigned long long) walk.checksum);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+// Compares Set with the linear vector set diamond used before (copied
+// below as LinearSet). Sets of type variables of a few sizes are built
+// the way type inference uses them: inserting with duplicates, looking
+// elements up and copying the sets around.
+//
+//     benchmarks/set [number of elements inserted per size]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/ast.hpp"
+#include "../src/data_structures.hpp"
+
+// Linear set
+// ----------
+template <typename T>
+struct LinearSet {
+    std::vector<T> elements;
+
+    void insert(T element) {
+        for (size_t i = 0; i < this->elements.size(); i++) {
+            if (this->elements[i] == element) {
+                return;
+            }
+        }
+        this->elements.push_back(element);
+    }
+
+    bool contains(T element) {
+        for (size_t i = 0; i < this->elements.size(); i++) {
+            if (this->elements[i] == element) return true;
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return this->elements.size();
+    }
+};
+
+// Measuring
+// ---------
+// Best of a few runs, in nanoseconds per set
+template <class S>
+static double measure(const std::vector<ast::Type>& types, size_t size, size_t sets, size_t& checksum) {
+    double best = 1e300;
+    for (size_t run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sets; i++) {
+            S set;
+            for (size_t j = 0; j < size; j++) {
+                set.insert(types[j]);
+                set.insert(types[j / 2]);
+            }
+            for (size_t j = 0; j < size; j++) {
+                checksum += set.contains(types[(j * 7) % types.size()]);
+            }
+            S copy = set;
+            checksum += copy.size();
+        }
+        best = std::min(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / sets);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t elements = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+
+    std::vector<ast::Type> types;
+    for (size_t i = 1; i <= 512; i++) {
+        types.push_back(ast::Type(ast::TypeVariable(i)));
+    }
+
+    size_t checksum = 0;
+    printf("elements   linear set   set          (ns per set, checksum)\n");
+    for (size_t size: {1, 2, 4, 8, 16, 64, 256}) {
+        size_t sets = std::max(elements / size, (size_t) 1);
+        double linear = measure<LinearSet<ast::Type>>(types, size, sets, checksum);
+        double set = measure<Set<ast::Type>>(types, size, sets, checksum);
+        printf("%-10zu %-12.1f %-12.1f %zu\n", size, linear, set, checksum);
+    }
+    return EXIT_SUCCESS;
+}
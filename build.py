@@ -12,19 +12,28 @@ name = 'diamond'
 source_files = [
     'src/main.cpp',
     'src/errors.cpp',
+    'src/symbols.cpp',
     'src/tokens.cpp',
     'src/lexer.cpp',
     'src/ast.cpp',
     'src/utilities.cpp',
+    'src/server.cpp',
+    'src/batch.cpp',
+    'src/trace.cpp',
+    'src/diamond.cpp',
     'src/parser.cpp',
     'src/semantic/context.cpp',
     'src/semantic/scopes.cpp',
+    'src/semantic/module_cache.cpp',
     'src/semantic/intrinsics.cpp',
     'src/semantic/semantic.cpp',
     'src/semantic/type_infer.cpp',
     'src/semantic/unify.cpp',
     'src/semantic/check_functions_used.cpp',
-    'src/codegen/codegen.cpp'
+    'src/semantic/call_graph.cpp',
+    'src/codegen/codegen.cpp',
+    'src/codegen/executable_cache.cpp',
+    'src/codegen/object_cache.cpp'
 ]
 
 # Platform specific constants
@@ -47,6 +56,18 @@ def get_default_llvm_config_path():
     elif platform.system() == 'Windows': return 'deps/llvm/bin/llvm-config'
     else: assert False
 
+def get_executable_name(name):
+    if   platform.system() == 'Linux': return name
+    if   platform.system() == 'Darwin': return name
+    elif platform.system() == 'Windows': return name + '.exe'
+    else: assert False
+
+def get_library_name():
+    if   platform.system() == 'Linux': return 'lib' + name + '.a'
+    if   platform.system() == 'Darwin': return 'lib' + name + '.a'
+    elif platform.system() == 'Windows': return name + '.lib'
+    else: assert False
+
 def get_lld_libraries():
     if   platform.system() == 'Linux': return '-llldELF -llldCommon'
     if   platform.system() == 'Darwin': return '-llldMachO -llldCommon'
@@ -109,24 +130,40 @@ def build_object_files(llvm_config):
         for result in results:
             if result == False: sys.exit(1)
 
-def build():
+def build_library(llvm_config, objects_files):
+    # Everything but main, for using the compiler as a library (see src/diamond.hpp)
+    command = f'{llvm_config} --bindir'
+    llvm_ar = os.path.join(subprocess.run(command.split(" "), capture_output=True, text=True).stdout.strip(), 'llvm-ar')
+    if platform.system() == 'Windows':
+        llvm_ar += '.exe'
+
+    objects_files = [file for file in objects_files if os.path.basename(file) != 'main' + get_object_file_extension()]
+    if os.path.exists(get_library_name()):
+        os.remove(get_library_name())
+
+    print("Creating library...")
+    result = subprocess.run([llvm_ar, 'rcs', get_library_name()] + objects_files, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        sys.exit(1)
+
+def get_llvm_config():
     llvm_config = get_default_llvm_config_path()
     if platform.system() == 'Windows':
         llvm_config += '.exe'
 
-    if len(sys.argv) > 1:
-        llvm_config = sys.argv[1]
+    arguments = [arg for arg in sys.argv[1:] if arg != '--benchmarks']
+    if len(arguments) > 0:
+        llvm_config = arguments[0]
 
     # Check llvm-config exists
     if not os.path.exists(llvm_config):
         print(f'Couldn\'t found llvm-config in {os.path.dirname(llvm_config)} :(')
         sys.exit(1)
 
-    # Build object files
-    build_object_files(llvm_config)
-    objects_files = list(map(lambda file: os.path.join('cache', file), os.listdir('cache')))
-    objects_files = ' '.join(objects_files)
+    return llvm_config
 
+def get_link_flags(llvm_config):
      # Get llvm libs
     command = f'{llvm_config} --libs --link-static'
     llvm_libs = subprocess.run(command.split(" "), capture_output=True, text=True).stdout.strip()
@@ -160,8 +197,19 @@ def build():
         system_libs = ["-l" + lib.split(".")[0] for lib in system_libs]
         system_libs = " ".join(system_libs)
 
+    return f'-L {libpath} {get_lld_libraries()} {llvm_libs} {system_libs}'
+
+def build():
+    llvm_config = get_llvm_config()
+
+    # Build object files
+    build_object_files(llvm_config)
+    objects_files = list(map(lambda file: os.path.join('cache', file), os.listdir('cache')))
+    build_library(llvm_config, objects_files)
+    objects_files = ' '.join(objects_files)
+
     # Build diamond
-    command = f'clang++ -std=c++17 {objects_files} -o {get_name()} -L {libpath} {get_lld_libraries()} {llvm_libs} {system_libs}'
+    command = f'clang++ -std=c++17 {objects_files} -o {get_name()} {get_link_flags(llvm_config)}'
     print("Linking...")
     result = subprocess.run(command.split(" "), capture_output=True, text=True)
     if result.returncode == 0:
@@ -170,6 +218,25 @@ def build():
         print(result.stderr)
         sys.exit(1)
 
+def build_benchmarks():
+    # Benchmarks are linked with the library, see benchmarks/
+    llvm_config = get_llvm_config()
+    command = f'{llvm_config} --includedir'
+    llvm_include_path = subprocess.run(command.split(" "), capture_output=True, text=True).stdout.strip()
+
+    for file in sorted(os.listdir('benchmarks')):
+        if not file.endswith('.cpp'): continue
+
+        source_file = os.path.join('benchmarks', file)
+        executable = os.path.join('benchmarks', get_executable_name(file.split('.')[0]))
+        command = f'clang++ -std=c++17 -O2 {source_file} {get_library_name()} -o {executable} -I {llvm_include_path} {get_link_flags(llvm_config)}'
+        print(command)
+
+        result = subprocess.run(command.split(" "), capture_output=True, text=True)
+        if result.returncode != 0:
+            print(result.stderr)
+            sys.exit(1)
+
 # Main
 # ----
 def main():
@@ -179,5 +246,8 @@ def main():
     else:
         print("Nothing to do...")
 
+    if '--benchmarks' in sys.argv:
+        build_benchmarks()
+
 if __name__ == "__main__":
     main()
@@ -3,6 +3,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <new>
 
 // Interface
 // ---------
@@ -65,11 +66,28 @@ std::vector<ast::FieldConstraint>::iterator ast::FieldTypes::end() {
     return this->fields.end();
 }
 
+std::vector<ast::FieldConstraint>::const_iterator ast::FieldTypes::begin() const {
+    return this->fields.begin();
+}
+
+std::vector<ast::FieldConstraint>::const_iterator ast::FieldTypes::end() const {
+    return this->fields.end();
+}
+
 std::size_t ast::FieldTypes::size() const {
     return this->fields.size();
 }
 
-std::vector<ast::FieldConstraint>::iterator ast::FieldTypes::find(std::string field_name) {
+std::vector<ast::FieldConstraint>::iterator ast::FieldTypes::find(const std::string& field_name) {
+    for (auto field = this->begin(); field != this->fields.end(); field++) {
+        if (field_name == field->name) {
+            return field;
+        }
+    }
+    return this->end();
+}
+
+std::vector<ast::FieldConstraint>::const_iterator ast::FieldTypes::find(const std::string& field_name) const {
     for (auto field = this->begin(); field != this->fields.end(); field++) {
         if (field_name == field->name) {
             return field;
@@ -131,23 +149,23 @@ ast::StructType& ast::Type::as_struct_type() {
     return std::get<ast::StructType>(this->type);
 }
 
-ast::NoType ast::Type::as_no_type() const {
+const ast::NoType& ast::Type::as_no_type() const {
     return std::get<ast::NoType>(this->type);
 }
 
-ast::TypeVariable ast::Type::as_type_variable() const {
+const ast::TypeVariable& ast::Type::as_type_variable() const {
     return std::get<ast::TypeVariable>(this->type);
 }
 
-ast::FinalTypeVariable ast::Type::as_final_type_variable() const {
+const ast::FinalTypeVariable& ast::Type::as_final_type_variable() const {
     return std::get<ast::FinalTypeVariable>(this->type);
 }
 
-ast::NominalType ast::Type::as_nominal_type() const {
+const ast::NominalType& ast::Type::as_nominal_type() const {
     return std::get<ast::NominalType>(this->type);
 }
 
-ast::StructType ast::Type::as_struct_type() const {
+const ast::StructType& ast::Type::as_struct_type() const {
     return std::get<ast::StructType>(this->type);
 }
 
@@ -179,7 +197,7 @@ bool ast::Type::operator==(const Type &t) const {
         return false;
     }
     else if (this->is_struct_type()) {
-        for (auto field: this->as_struct_type().fields) {
+        for (auto& field: this->as_struct_type().fields) {
             if (t.as_struct_type().fields.find(field.name) == t.as_struct_type().fields.end()) {
                 return false;
             }
@@ -251,7 +269,7 @@ std::string ast::Type::to_str() const {
     else if (this->is_struct_type()) {
         output += "struct {";
         
-        auto fields = this->as_struct_type().fields;
+        auto& fields = this->as_struct_type().fields;
         for(auto field = fields.begin(); field != fields.end(); field++) {
             output += field->name + ": " + field->type.to_str();
 
@@ -425,13 +443,14 @@ bool ast::Type::is_array() const {
         return false;
     }
 
-    if (this->as_nominal_type().name.size() < 5
-    || this->as_nominal_type().name.substr(0, 5) != "Array") {
+    const std::string& name = this->as_nominal_type().name.str();
+    if (name.size() < 5
+    || name.substr(0, 5) != "Array") {
         return false;
     }
 
-    if (this->as_nominal_type().name.size() > 5
-    && !is_number(this->as_nominal_type().name.substr(5, this->as_nominal_type().name.size()))) {
+    if (name.size() > 5
+    && !is_number(name.substr(5, name.size()))) {
         return false;
     }
     
@@ -451,18 +470,42 @@ bool ast::Type::is_collection() const {
 
 size_t ast::Type::array_size_known() const {
     assert(this->is_array());
-    return this->as_nominal_type().name.size() > 5;
+    return this->as_nominal_type().name.str().size() > 5;
 }
 
 size_t ast::Type::get_array_size() const {
     assert(this->is_array());
-    assert(this->as_nominal_type().name.size() > 5);
-    return stoi(std::get<ast::NominalType>(this->type).name.substr(5, this->as_nominal_type().name.size()));
+    const std::string& name = std::get<ast::NominalType>(this->type).name.str();
+    assert(name.size() > 5);
+    return stoi(name.substr(5, name.size()));
 }
 
 // Add hash struct for ast::Type to be able to use ast::Type as keys of std::unordered_map
+// The hash is computed from the structure of the type and has to agree with
+// ast::Type::operator==, so it only uses what equality compares.
+static void hash_combine(std::size_t& seed, std::size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
 std::size_t std::hash<ast::Type>::operator()(const ast::Type& type) const {
-    return std::hash<std::string>()(type.to_str());
+    std::size_t seed = type.type.index();
+
+    if (type.is_type_variable()) {
+        hash_combine(seed, type.as_type_variable().id);
+    }
+    else if (type.is_final_type_variable()) {
+        hash_combine(seed, std::hash<symbol::Symbol>()(type.as_final_type_variable().id));
+    }
+    else if (type.is_nominal_type()) {
+        hash_combine(seed, std::hash<symbol::Symbol>()(type.as_nominal_type().name));
+        for (auto& parameter: type.as_nominal_type().parameters) {
+            hash_combine(seed, (*this)(parameter));
+        }
+    }
+
+    // Struct types are compared field by field as a subset, so they can
+    // only be hashed by their kind.
+    return seed;
 }
 
 // Node
@@ -674,44 +717,44 @@ size_t ast::TypeNode::get_index_of_field(std::string field_name) {
 
 // Ast
 // ---
-size_t ast::Ast::capacity() {
-    size_t result = 0;
-    for (size_t i = 0; i < this->nodes.size(); i++) {
-        result += this->initial_size * pow(this->growth_factor, i);
-    }
-    return result;
-}
-
 void ast::Ast::push_back(Node node) {
-    if (this->size + 1 > this->capacity()) {
-        Node* array = new Node[this->initial_size * static_cast<unsigned int>(pow(this->growth_factor, this->nodes.size()))];
-        this->nodes.push_back(array);
+    if (this->chunks.empty() || this->chunks.back().size == this->chunks.back().capacity) {
+        size_t capacity = this->chunks.empty() ? this->initial_size : this->chunks.back().capacity * this->growth_factor;
+        this->chunks.push_back(Chunk {static_cast<Node*>(::operator new(sizeof(Node) * capacity)), capacity, 0});
     }
 
+    Chunk& chunk = this->chunks.back();
+    new (&chunk.nodes[chunk.size]) Node(std::move(node));
+    chunk.size++;
     this->size++;
-    this->nodes[this->nodes.size() - 1][this->size - 1 - this->size_of_arrays_filled()] = node;
-}
-
-size_t ast::Ast::size_of_arrays_filled() {
-    if (this->nodes.size() == 0) return 0;
-    else {
-        size_t size_of_arrays_filled = 0;
-        for (size_t i = 0; i < this->nodes.size() - 1; i++) {
-            size_of_arrays_filled += this->initial_size * static_cast<unsigned int>(pow(this->growth_factor, i));
-        }
-        return size_of_arrays_filled;
-    }
 }
 
 ast::Node* ast::Ast::last_element() {
     if (this->size == 0) return nullptr;
-    else                 return &this->nodes[this->nodes.size() - 1][this->size - 1 - this->size_of_arrays_filled()];
+    else                 return &this->chunks.back().nodes[this->chunks.back().size - 1];
+}
+
+void ast::Ast::merge(Ast& other) {
+    // Chunks are inserted before the current last one so the nodes
+    // pushed next still go where last_element expects them.
+    auto position = this->chunks.empty() ? this->chunks.end() : this->chunks.end() - 1;
+    this->chunks.insert(position, other.chunks.begin(), other.chunks.end());
+    this->size += other.size;
+
+    other.chunks = {};
+    other.size = 0;
 }
 
 void ast::Ast::free() {
-    for (size_t i = 0; i < this->nodes.size(); i++) {
-        delete[] this->nodes[i];
+    for (Chunk& chunk : this->chunks) {
+        for (size_t i = 0; i < chunk.size; i++) {
+            chunk.nodes[i].~Node();
+        }
+        ::operator delete(chunk.nodes);
     }
+
+    this->chunks = {};
+    this->size = 0;
 }
 
 // Print
@@ -1359,6 +1402,39 @@ bool ast::FunctionNode::is_in_type_parameter(ast::Type type) {
     return false;
 }
 
+static size_t hash_args(const std::vector<ast::Type>& args) {
+    size_t seed = args.size();
+    for (auto& arg: args) {
+        seed ^= std::hash<ast::Type>()(arg) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+// Returns the first specialization with the same args. If the return type
+// is concrete it also has to match.
+ast::FunctionSpecialization* ast::FunctionNode::get_specialization(const std::vector<ast::Type>& args, const ast::Type& return_type) {
+    if (!this->specializations_index) return nullptr;
+    auto it = this->specializations_index->find(hash_args(args));
+    if (it == this->specializations_index->end()) return nullptr;
+
+    for (size_t index: it->second) {
+        auto& specialization = this->specializations[index];
+        if (specialization.args == args
+        && (!return_type.is_concrete() || specialization.return_type == return_type)) {
+            return &specialization;
+        }
+    }
+    return nullptr;
+}
+
+ast::FunctionSpecialization* ast::FunctionNode::add_specialization(FunctionSpecialization specialization) {
+    if (!this->specializations_index) {
+        this->specializations_index = std::make_unique<std::unordered_map<size_t, std::vector<size_t>>>();
+    }
+    (*this->specializations_index)[hash_args(specialization.args)].push_back(this->specializations.size());
+    this->specializations.push_back(std::move(specialization));
+    return &this->specializations.back();
+}
 
 bool ast::InterfaceNode::typed_parameter_aready_added(ast::Type type) {
     for (auto type_parameter: this->type_parameters) {
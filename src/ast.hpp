@@ -7,10 +7,12 @@
 #include <unordered_map>
 #include <filesystem>
 #include <optional>
+#include <memory>
 #include <cmath>
 #include <cassert>
 #include <iostream>
 #include "data_structures.hpp"
+#include "symbols.hpp"
 
 namespace ast {
     struct BlockNode;
@@ -112,8 +114,11 @@ namespace ast {
 
         std::vector<FieldConstraint>::iterator begin();
         std::vector<FieldConstraint>::iterator end();
+        std::vector<FieldConstraint>::const_iterator begin() const;
+        std::vector<FieldConstraint>::const_iterator end() const;
         std::size_t size() const;
-        std::vector<FieldConstraint>::iterator find(std::string field_name);
+        std::vector<FieldConstraint>::iterator find(const std::string& field_name);
+        std::vector<FieldConstraint>::const_iterator find(const std::string& field_name) const;
         ast::Type& operator[](const std::string& field_name);
         const ast::Type& operator[](const std::string& field_name) const;
         std::string to_str() const;
@@ -144,7 +149,7 @@ namespace ast {
     };
 
     struct FinalTypeVariable {
-        std::string id;
+        symbol::Symbol id;
         std::vector<ast::FieldConstraint> field_constraints;
         std::vector<ast::Type> parameter_constraints;
 
@@ -152,7 +157,7 @@ namespace ast {
     };
 
     struct NominalType {
-        std::string name;
+        symbol::Symbol name;
         std::vector<Type> parameters;
         TypeNode* type_definition = nullptr;
 
@@ -192,11 +197,11 @@ namespace ast {
         ast::NominalType& as_nominal_type();
         ast::StructType& as_struct_type();
 
-        ast::NoType as_no_type() const;
-        ast::TypeVariable as_type_variable() const;
-        ast::FinalTypeVariable as_final_type_variable() const;
-        ast::NominalType as_nominal_type() const;
-        ast::StructType as_struct_type() const;
+        const ast::NoType& as_no_type() const;
+        const ast::TypeVariable& as_type_variable() const;
+        const ast::FinalTypeVariable& as_final_type_variable() const;
+        const ast::NominalType& as_nominal_type() const;
+        const ast::StructType& as_struct_type() const;
 
         bool operator==(const Type &t) const;
         bool operator!=(const Type &t) const;
@@ -248,8 +253,8 @@ namespace ast {
     };
 
     struct BlockNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         std::vector<Node*> statements;
@@ -260,8 +265,8 @@ namespace ast {
     };
 
     struct FunctionArgumentNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         bool is_mutable = false;
@@ -283,8 +288,8 @@ namespace ast {
     };
 
     struct FunctionNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         IdentifierNode* identifier;
@@ -296,20 +301,24 @@ namespace ast {
         bool is_extern = false;
         bool is_extern_and_variadic = false;
         bool is_builtin = false;
+        bool return_type_is_mutable = false;
+        bool is_used = false;
+        bool is_analyzed = false; // Set when its analysis starts, functions from modules are analyzed on demand
         std::vector<FunctionSpecialization> specializations;
+        std::unique_ptr<std::unordered_map<size_t, std::vector<size_t>>> specializations_index; // Hash of args to positions in specializations, only allocated for functions with specializations
         Type return_type = Type(ast::NoType{});
-        bool return_type_is_mutable = false;
         std::filesystem::path module_path; // Used in to tell from which module the function comes from
-        bool is_used = false;
 
         bool typed_parameter_aready_added(ast::Type type);
         std::optional<ast::TypeParameter*> get_type_parameter(ast::Type type);
         bool is_in_type_parameter(ast::Type type);
+        FunctionSpecialization* get_specialization(const std::vector<ast::Type>& args, const ast::Type& return_type);
+        FunctionSpecialization* add_specialization(FunctionSpecialization specialization);
     };
 
     struct InterfaceNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         IdentifierNode* identifier;
@@ -332,8 +341,8 @@ namespace ast {
     std::optional<ast::TypeParameter*> get_type_parameter(std::vector<ast::TypeParameter>& type_parameters, ast::Type type);
 
     struct TypeNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         IdentifierNode* identifier;
@@ -345,8 +354,8 @@ namespace ast {
     };
 
     struct DeclarationNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         bool is_mutable = false;
@@ -356,8 +365,8 @@ namespace ast {
     };
 
     struct AssignmentNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         Node* assignable;
@@ -365,28 +374,28 @@ namespace ast {
     };
 
     struct ReturnNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         std::optional<Node*> expression;
     };
 
     struct BreakNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
     };
 
     struct ContinueNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
     };
 
     struct IfElseNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         Node* condition;
@@ -395,8 +404,8 @@ namespace ast {
     };
 
     struct WhileNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         Node* condition;
@@ -404,8 +413,8 @@ namespace ast {
     };
 
     struct UseNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         StringNode* path;
@@ -413,16 +422,16 @@ namespace ast {
     };
 
     struct LinkWithNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         StringNode* directives;
     };
 
     struct CallArgumentNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         bool is_mutable = false;
@@ -431,9 +440,9 @@ namespace ast {
     };
 
     struct CallNode {
-        size_t line;
-        size_t end_line;
-        size_t column;
+        uint32_t line;
+        uint32_t end_line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         IdentifierNode* identifier;
@@ -449,9 +458,9 @@ namespace ast {
     };
 
     struct StructLiteralNode {
-        size_t line;
-        size_t end_line;
-        size_t column;
+        uint32_t line;
+        uint32_t end_line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         IdentifierNode* identifier;
@@ -459,48 +468,48 @@ namespace ast {
     };
 
     struct FloatNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         double value;
     };
 
     struct IntegerNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         int64_t value;
     };
 
     struct IdentifierNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
-        std::string value;
+        symbol::Symbol value;
     };
 
     struct BooleanNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         bool value;
     };
 
     struct StringNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         std::string value;
     };
 
     struct InterpolatedStringNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         std::vector<std::string> strings;
@@ -508,16 +517,16 @@ namespace ast {
     };
 
     struct ArrayNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         std::vector<Node*> elements;
     };
 
     struct FieldAccessNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         ast::Node* accessed;
@@ -525,47 +534,63 @@ namespace ast {
     };
 
     struct AddressOfNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
 
         ast::Node* expression;
     };
 
     struct DereferenceNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
     
         ast::Node* expression;
     };
 
     struct NewNode {
-        size_t line;
-        size_t column;
+        uint32_t line;
+        uint32_t column;
         Type type = Type(ast::NoType{});
     
         ast::Node* expression;
     };
 
+    struct ParsedModule {
+        std::string source;
+        BlockNode* block = nullptr;
+        std::vector<std::string> link_with;
+        std::vector<std::string> errors;
+    };
+
     struct Ast {
         // High level
         BlockNode* program;
         std::filesystem::path module_path;
         std::unordered_map<std::string, BlockNode*> modules;
+        std::unordered_map<std::string, uint64_t> module_hashes; // Modules that can be cached, see semantic/module_cache.hpp
         std::vector<std::string> link_with;
 
+        std::unordered_map<std::string, ParsedModule> parsed_modules; // Parsed ahead of analysis, see semantic::parse_modules
+
         // Storage
-        std::vector<Node*> nodes;
-        unsigned int growth_factor = 2;
-        unsigned int initial_size = 20;
+        // Nodes are bump allocated in chunks that never move, so pointers
+        // to nodes stay valid for the lifetime of the ast.
+        struct Chunk {
+            Node* nodes;
+            size_t capacity;
+            size_t size;
+        };
+        std::vector<Chunk> chunks;
+        size_t growth_factor = 2;
+        size_t initial_size = 64;
         size_t size = 0;
 
         // Methods
-        size_t capacity();
         void push_back(Node node);
-        size_t size_of_arrays_filled();
         Node* last_element();
+        void merge(Ast& other); // Takes ownership of the nodes of other
         void free();
     };
 
@@ -589,6 +614,13 @@ namespace std {
     struct hash<ast::Type> {
         std::size_t operator()(const ast::Type& type) const;
     };
+
+    template <>
+    struct hash<ast::InterfaceType> {
+        std::size_t operator()(const ast::InterfaceType& interface) const {
+            return std::hash<std::string>()(interface.name);
+        }
+    };
 };
 
 #endif
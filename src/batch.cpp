@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+
+#ifdef _WIN32
+#include <atomic>
+#include <mutex>
+#include <thread>
+#else
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "batch.hpp"
+#include "diamond.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic.hpp"
+#include "trace.hpp"
+#include "utilities.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Files that don't parse are kept, building them reports the errors
+static void add_used_modules(std::filesystem::path file, std::set<std::filesystem::path>& used_modules) {
+    std::string source = utilities::read_file(file);
+    auto tokens = lexer::lex(source, file);
+    if (tokens.is_error()) return;
+
+    ast::Ast ast;
+    if (parse::module(ast, tokens.get_value(), file).is_ok()) {
+        for (auto& use_stmt: ast.modules[file.string()]->use_statements) {
+            std::error_code error;
+            auto use_path = std::filesystem::canonical(file.parent_path() / (use_stmt->path->value + ".dmd"), error);
+            if (!error) used_modules.insert(use_path);
+        }
+    }
+    ast.free();
+}
+
+// Files in directories that other files there use are modules, not
+// programs, so they are skipped. Files given by name are always built.
+static std::vector<std::filesystem::path> get_programs(std::vector<std::filesystem::path> paths) {
+    std::vector<std::filesystem::path> programs;
+    for (auto& path: paths) {
+        if (!std::filesystem::is_directory(path)) {
+            programs.push_back(path);
+            continue;
+        }
+
+        std::vector<std::filesystem::path> found;
+        std::set<std::filesystem::path> used_modules;
+        for (auto& entry: std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".dmd") {
+                found.push_back(entry.path());
+                add_used_modules(entry.path(), used_modules);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (auto& file: found) {
+            std::error_code error;
+            auto canonical_path = std::filesystem::canonical(file, error);
+            if (error || used_modules.find(canonical_path) == used_modules.end()) programs.push_back(file);
+        }
+    }
+    return programs;
+}
+
+static void print_result(std::filesystem::path program, bool ok, std::string diagnostics, Clock::duration duration) {
+    char seconds[32];
+    std::snprintf(seconds, sizeof(seconds), "%.3fs", std::chrono::duration<double>(duration).count());
+    std::cout << (ok ? "OK     " : "FAILED ") << program.string() << " (" << seconds << ")\n";
+    std::cout << diagnostics;
+    std::cout.flush();
+}
+
+static std::string build_program(std::filesystem::path program, codegen::Options options, bool& ok) {
+    diamond::Compilation compilation(program, options);
+    ok = compilation.build();
+
+    std::string diagnostics;
+    for (auto& diagnostic: compilation.diagnostics) {
+        diagnostics += diagnostic + "\n";
+    }
+    return diagnostics;
+}
+
+#ifndef _WIN32
+// Each fork writes its diagnostics, and anything else it prints, to a pipe
+// and exits with 0 if the program was built.
+struct Job {
+    std::filesystem::path program;
+    pid_t pid;
+    int pipe;
+    std::string diagnostics;
+    Clock::time_point start;
+};
+
+int batch::build(std::vector<std::filesystem::path> paths, codegen::Options options) {
+    auto start = Clock::now();
+    auto programs = get_programs(paths);
+
+    // Shared by every program
+    codegen::initialize_targets();
+    semantic::load_prelude();
+
+    size_t jobs = options.jobs;
+    options.jobs = 1;
+
+    size_t next_program = 0;
+    size_t built = 0;
+    std::vector<Job> running;
+    while (next_program < programs.size() || running.size() > 0) {
+        // Start programs
+        while (next_program < programs.size() && running.size() < jobs) {
+            auto program = programs[next_program++];
+
+            int fds[2];
+            if (pipe(fds) != 0) {
+                print_result(program, false, "The program couldn't be built, pipe() failed.\n", Clock::duration::zero());
+                continue;
+            }
+
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                // Output printed while building, like failed assertions,
+                // goes with the program instead of in between the results.
+                // It isn't buffered so it isn't lost if the compiler crashes.
+                close(fds[0]);
+                dup2(fds[1], STDOUT_FILENO);
+                dup2(fds[1], STDERR_FILENO);
+                close(fds[1]);
+                std::cout << std::unitbuf;
+
+                // Each program gets its own trace
+                if (trace::is_enabled()) {
+                    trace::start(program.parent_path() / (program.stem().string() + ".trace.json"));
+                }
+
+                bool ok = false;
+                std::string diagnostics = build_program(program, options, ok);
+                std::cout << diagnostics;
+                std::fflush(stdout);
+                trace::finish();
+                _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+
+            close(fds[1]);
+            if (pid == -1) {
+                close(fds[0]);
+                print_result(program, false, "The program couldn't be built, fork() failed.\n", Clock::duration::zero());
+                continue;
+            }
+            running.push_back(Job {program, pid, fds[0], "", Clock::now()});
+        }
+        if (running.size() == 0) break;
+
+        // Read diagnostics, a program is done when its pipe is closed
+        std::vector<pollfd> fds;
+        for (auto& job: running) {
+            fds.push_back(pollfd {job.pipe, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) == -1) continue;
+
+        for (size_t i = running.size(); i-- > 0;) {
+            if (fds[i].revents == 0) continue;
+
+            char buffer[4096];
+            ssize_t size = read(running[i].pipe, buffer, sizeof(buffer));
+            if (size > 0) {
+                running[i].diagnostics.append(buffer, size);
+                continue;
+            }
+
+            int wait_status = 0;
+            close(running[i].pipe);
+            waitpid(running[i].pid, &wait_status, 0);
+            bool ok = WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == EXIT_SUCCESS;
+            if (WIFSIGNALED(wait_status)) {
+                running[i].diagnostics += "The program couldn't be built, the compiler was killed by signal " + std::to_string(WTERMSIG(wait_status)) + ".\n";
+            }
+            if (ok) built++;
+            print_result(running[i].program, ok, running[i].diagnostics, Clock::now() - running[i].start);
+            running.erase(running.begin() + i);
+        }
+    }
+
+    char seconds[32];
+    std::snprintf(seconds, sizeof(seconds), "%.3fs", std::chrono::duration<double>(Clock::now() - start).count());
+    std::cout << "Built " << built << " of " << programs.size() << " programs in " << seconds << "\n";
+    return built == programs.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#else
+int batch::build(std::vector<std::filesystem::path> paths, codegen::Options options) {
+    auto start = Clock::now();
+    auto programs = get_programs(paths);
+
+    size_t jobs = std::min(options.jobs, std::max(programs.size(), (size_t) 1));
+    options.jobs = 1;
+
+    std::mutex mutex;
+    std::atomic<size_t> next_program = 0;
+    size_t built = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < jobs; i++) {
+        threads.push_back(std::thread([&] {
+            for (size_t i = next_program++; i < programs.size(); i = next_program++) {
+                auto program_start = Clock::now();
+                bool ok = false;
+                std::string diagnostics = build_program(programs[i], options, ok);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ok) built++;
+                print_result(programs[i], ok, diagnostics, Clock::now() - program_start);
+            }
+        }));
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    char seconds[32];
+    std::snprintf(seconds, sizeof(seconds), "%.3fs", std::chrono::duration<double>(Clock::now() - start).count());
+    std::cout << "Built " << built << " of " << programs.size() << " programs in " << seconds << "\n";
+    return built == programs.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
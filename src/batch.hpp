@@ -0,0 +1,20 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <filesystem>
+#include <vector>
+
+#include "codegen.hpp"
+
+namespace batch {
+    // Builds many programs with one command, each executable is put next
+    // to its program. Directories are searched for programs, leaving out
+    // the modules other files there use. std is analyzed once and every
+    // program is built in a fork that starts from it, options.jobs of them
+    // at the same time. On Windows the programs are built on threads
+    // instead, analyzing std each time. Prints how each program went and
+    // returns the exit status.
+    int build(std::vector<std::filesystem::path> paths, codegen::Options options);
+}
+
+#endif
@@ -1,13 +1,44 @@
 #ifndef CODEGEN_HPP
 #define CODEGEN_HPP
 
+#include <string>
+
 #include "ast.hpp"
+#include "shared.hpp"
 
 namespace codegen {
-    void generate_executable(ast::Ast& ast, std::string program_name);
-    void print_llvm_ir(ast::Ast& ast, std::string program_name);
-    void generate_object_code(ast::Ast& ast, std::string program_name);
-    void print_assembly(ast::Ast& ast, std::string program_name);
+    enum OptimizationLevel {
+        DefaultOptimization, // A few function passes, quick to compile
+        O0,
+        O1,
+        O2,
+        O3,
+        Os
+    };
+
+    struct Options {
+        size_t jobs = 1; // Number of threads used to optimize and emit the object code
+        OptimizationLevel optimization_level = DefaultOptimization;
+        std::string target_cpu = "generic"; // "native" uses the cpu and features of the host
+        std::string target_features = "";   // Like "+avx2,+fma"
+    };
+
+    // What code is generated for, with "native" resolved to the cpu and
+    // features of the host. Cached object files and executables are keyed
+    // by it, so a cache shared between machines doesn't mix them up.
+    struct Target {
+        std::string triple;
+        std::string cpu;
+        std::string features;
+    };
+
+    void initialize_targets(); // Done before generating code, can be called more than once
+    Target get_target(Options options);
+    Result<Ok, Error> generate_executable(ast::Ast& ast, std::string program_name, Options options = Options{});
+    bool run_with_jit(ast::Ast& ast, std::string program_name, Options options = Options{});
+    void print_llvm_ir(ast::Ast& ast, std::string program_name, Options options = Options{});
+    void generate_object_code(ast::Ast& ast, std::string program_name, Options options = Options{});
+    void print_assembly(ast::Ast& ast, std::string program_name, Options options = Options{});
 }
 
 #endif
@@ -3,35 +3,77 @@
 #include <unordered_map>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
 #include <assert.h>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "../codegen.hpp"
 #include "codegen.hpp"
+#include "object_cache.hpp"
 #include "../utilities.hpp"
+#include "../trace.hpp"
 #include "../semantic/intrinsics.hpp"
+#include "../semantic/call_graph.hpp"
 
-// Print LLVM IR
-// -------------
-void codegen::print_llvm_ir(ast::Ast& ast, std::string program_name) {
-    codegen::Context llvm_ir(ast);
-    llvm_ir.codegen(ast);
-    llvm_ir.module->print(llvm::outs(), nullptr);
+// Target
+// ------
+void codegen::initialize_targets() {
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+    });
 }
 
+// Features are a comma separated list like "+avx2,-fma"
+static std::string get_host_cpu_features() {
+    llvm::StringMap<bool> host_features;
+    if (!llvm::sys::getHostCPUFeatures(host_features)) return "";
 
-// Print assembly
-// --------------
-void codegen::print_assembly(ast::Ast& ast, std::string program_name) {
-    codegen::Context llvm_ir(ast);
-    llvm_ir.codegen(ast);
+    std::vector<std::string> features;
+    for (auto& feature: host_features) {
+        features.push_back((feature.getValue() ? "+" : "-") + feature.getKey().str());
+    }
+    std::sort(features.begin(), features.end());
 
-    // Select target
-    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+    std::string result = "";
+    for (auto& feature: features) {
+        if (result.size() > 0) result += ",";
+        result += feature;
+    }
+    return result;
+}
+
+codegen::Target codegen::get_target(codegen::Options options) {
+    codegen::Target target = {llvm::sys::getDefaultTargetTriple(), options.target_cpu, ""};
+
+    // The features given explicitly go last so they override the ones of the cpu
+    if (target.cpu == "native") {
+        target.cpu = llvm::sys::getHostCPUName().str();
+        target.features = get_host_cpu_features();
+    }
+    if (options.target_features.size() > 0) {
+        if (target.features.size() > 0) target.features += ",";
+        target.features += options.target_features;
+    }
+    return target;
+}
+
+static llvm::TargetMachine* create_target_machine(codegen::Options options) {
+    auto target = codegen::get_target(options);
+    auto TargetTriple = target.triple;
 
     std::string Error;
     auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
@@ -40,94 +82,360 @@ void codegen::print_assembly(ast::Ast& ast, std::string program_name) {
         llvm::errs() << Error;
     }
 
-    auto CPU = "generic";
-    auto Features = "";
+    std::string CPU = target.cpu;
+    std::string Features = target.features;
 
     llvm::TargetOptions opt;
     auto RM = llvm::Optional<llvm::Reloc::Model>();
-    auto TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
 
-    llvm_ir.module->setDataLayout(TargetMachine->createDataLayout());
-    llvm_ir.module->setTargetTriple(TargetTriple);
+    // Instruction selection and register allocation effort
+    auto OL = llvm::CodeGenOpt::Default;
+    if      (options.optimization_level == codegen::O0) OL = llvm::CodeGenOpt::None;
+    else if (options.optimization_level == codegen::O1) OL = llvm::CodeGenOpt::Less;
+    else if (options.optimization_level == codegen::O3) OL = llvm::CodeGenOpt::Aggressive;
 
-    // Generate assembly
-    llvm::legacy::PassManager pass;
+    return Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM, llvm::None, OL);
+}
+
+static void emit_file(llvm::Module* module, llvm::TargetMachine* target_machine, llvm::raw_pwrite_stream& dest, llvm::CodeGenFileType file_type) {
+    module->setDataLayout(target_machine->createDataLayout());
+    module->setTargetTriple(target_machine->getTargetTriple().str());
 
-    auto& llvm_outs = llvm::outs();
-    if (TargetMachine->addPassesToEmitFile(pass, llvm_outs, nullptr, llvm::CGFT_AssemblyFile)) {
+    trace::Span span("Emit object code");
+    llvm::legacy::PassManager pass;
+    if (target_machine->addPassesToEmitFile(pass, dest, nullptr, file_type)) {
         llvm::errs() << "TargetMachine can't emit a file of this type";
     }
 
-    pass.run(*(llvm_ir.module));
-    llvm_outs.flush();
+    pass.run(*module);
+    dest.flush();
+}
+
+static void emit_object_file(llvm::Module* module, llvm::TargetMachine* target_machine, std::string object_file_name) {
+    std::error_code EC;
+    llvm::raw_fd_ostream dest(object_file_name, EC, llvm::sys::fs::OF_None);
+
+    if (EC) {
+        llvm::errs() << "Could not open file: " << EC.message();
+    }
+
+    emit_file(module, target_machine, dest, llvm::CGFT_ObjectFile);
+}
+
+// Print LLVM IR
+// -------------
+void codegen::print_llvm_ir(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    codegen::Context llvm_ir(ast, options.optimization_level);
+    llvm_ir.codegen(ast);
+
+    codegen::initialize_targets();
+    std::unique_ptr<llvm::TargetMachine> target_machine(create_target_machine(options));
+    llvm_ir.optimize(target_machine.get());
+    llvm_ir.module->print(llvm::outs(), nullptr);
+}
+
+
+// Print assembly
+// --------------
+void codegen::print_assembly(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    codegen::Context llvm_ir(ast, options.optimization_level);
+    llvm_ir.codegen(ast);
+
+    codegen::initialize_targets();
+    std::unique_ptr<llvm::TargetMachine> target_machine(create_target_machine(options));
+    llvm_ir.optimize(target_machine.get());
+
+    // Generate assembly
+    emit_file(llvm_ir.module, target_machine.get(), llvm::outs(), llvm::CGFT_AssemblyFile);
 }
 
 
 // Generate object code
 // --------------------
 static std::string get_object_file_name(std::string executable_name);
-static void link(std::string executable_name, std::string object_file_name, std::vector<std::string> link_directives);
+static Result<Ok, Error> link(std::string executable_name, std::vector<std::string> object_files, std::vector<std::string> link_directives);
+static std::vector<std::pair<std::string, ast::BlockNode*>> get_modules_in_order(ast::Ast& ast);
 
-void codegen::generate_object_code(ast::Ast& ast, std::string program_name) {
-    codegen::Context llvm_ir(ast);
+void codegen::generate_object_code(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    codegen::Context llvm_ir(ast, options.optimization_level);
     llvm_ir.codegen(ast);
 
-    // Select target
-    auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+    codegen::initialize_targets();
+    std::unique_ptr<llvm::TargetMachine> target_machine(create_target_machine(options));
+    llvm_ir.optimize(target_machine.get());
 
-    std::string Error;
-    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
+    // Generate object code
+    emit_object_file(llvm_ir.module, target_machine.get(), get_object_file_name(program_name));
+}
+
+// Object files for the linker are emitted to memory and, on Linux, handed
+// to it as memory backed files (memfd), so only the executable is written
+// to disk. On other platforms they are written next to the executable.
+struct ObjectFile {
+    std::string path;
+    int fd = -1;
+    bool is_cached = false; // Taken from or saved to the object cache
+};
+
+// Another build can trim the cache while this one links (see
+// codegen::trim_object_cache), so the object files taken from it are kept
+// alive until linking ends. On Linux the file is opened and handed to the
+// linker through its descriptor, which still reads the file if it's
+// removed. On other platforms it's hard linked, or copied, next to the
+// executable. Returns nullopt if the file was already removed.
+static std::optional<ObjectFile> take_cached_object_file(std::filesystem::path cache_file, std::string object_file_name) {
+#ifdef __linux__
+    int fd = open(cache_file.c_str(), O_RDONLY);
+    if (fd == -1) return std::nullopt;
+    utilities::mark_as_used(cache_file);
+    return ObjectFile {"/proc/self/fd/" + std::to_string(fd), fd, true};
+#else
+    std::error_code error;
+    std::filesystem::remove(object_file_name, error);
+    std::filesystem::create_hard_link(cache_file, object_file_name, error);
+    if (error) {
+        error.clear();
+        std::filesystem::copy_file(cache_file, object_file_name, error);
+        if (error) return std::nullopt;
+    }
+    utilities::mark_as_used(cache_file);
+    return ObjectFile {object_file_name, -1, true};
+#endif
+}
 
-    if (!Target) {
-        llvm::errs() << Error;
+static ObjectFile store_object_file(std::string object_file_name, const llvm::SmallVector<char, 0>& buffer) {
+#ifdef __linux__
+    // The descriptor is inherited by the linker when it runs as another process
+    int fd = memfd_create(object_file_name.c_str(), 0);
+    if (fd != -1) {
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t result = write(fd, buffer.data() + written, buffer.size() - written);
+            if (result <= 0) break;
+            written += (size_t) result;
+        }
+        if (written == buffer.size()) return ObjectFile {"/proc/self/fd/" + std::to_string(fd), fd};
+        close(fd);
     }
+#endif
 
-    auto CPU = "generic";
-    auto Features = "";
+    std::ofstream file(object_file_name, std::ios::binary);
+    file.write(buffer.data(), buffer.size());
+    return ObjectFile {object_file_name};
+}
 
-    llvm::TargetOptions opt;
-    auto RM = llvm::Optional<llvm::Reloc::Model>();
-    auto TargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+static void remove_object_file(ObjectFile& object_file) {
+#ifdef __linux__
+    if (object_file.fd != -1) {
+        close(object_file.fd);
+        return;
+    }
+#endif
+    remove(object_file.path.c_str());
+}
+
+// When there is a cache directory and the program isn't optimized every
+// module gets its own llvm module, and the ones that didn't change since
+// the last build are taken from the cache (see codegen/object_cache.hpp).
+// Otherwise the functions are split between as many llvm modules as jobs.
+// Generating the llvm ir is done serially because it reads the ast, then
+// the llvm modules are optimized and emitted using as many threads as jobs.
+struct Partition {
+    std::unique_ptr<codegen::Context> llvm_ir;
+    std::optional<std::filesystem::path> cache_file;
+    llvm::SmallVector<char, 0> buffer;
+};
+
+// Functions calling each other go in the same llvm module, so they can
+// still be inlined into each other. The groups of functions that call each
+// other are handed out biggest first to the partition with fewer function
+// bodies. Calls from the top level of the program can cross partitions.
+static std::unordered_map<const ast::FunctionNode*, size_t> get_function_partitions(ast::Ast& ast, size_t partitions) {
+    std::vector<ast::FunctionNode*> functions;
+    for (auto& module: get_modules_in_order(ast)) {
+        for (auto function: module.second->functions) {
+            if (function->is_extern || function->is_builtin) continue;
+            functions.push_back(function);
+        }
+    }
 
-    llvm_ir.module->setDataLayout(TargetMachine->createDataLayout());
-    llvm_ir.module->setTargetTriple(TargetTriple);
+    struct Group {
+        std::vector<ast::FunctionNode*> functions;
+        size_t bodies = 0;
+    };
+    std::vector<Group> groups;
+    for (auto& functions_in_group: semantic::group_by_calls(functions)) {
+        Group group = {functions_in_group};
+        for (auto function: functions_in_group) {
+            if (function->state != ast::FunctionCompletelyTyped) group.bodies += function->specializations.size();
+            else if (function->is_used)                          group.bodies += 1;
+        }
+        groups.push_back(group);
+    }
+    std::stable_sort(groups.begin(), groups.end(), [](auto& a, auto& b) {return a.bodies > b.bodies;});
+
+    std::unordered_map<const ast::FunctionNode*, size_t> function_partitions;
+    std::vector<size_t> bodies(partitions, 0);
+    for (auto& group: groups) {
+        size_t partition = std::min_element(bodies.begin(), bodies.end()) - bodies.begin();
+        bodies[partition] += group.bodies;
+        for (auto function: group.functions) {
+            function_partitions[function] = partition;
+        }
+    }
+    return function_partitions;
+}
+
+static std::vector<ObjectFile> generate_object_files(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    trace::Span span("Codegen");
+    codegen::initialize_targets();
+
+    std::vector<ObjectFile> object_files;
+    std::unordered_map<const ast::FunctionNode*, size_t> function_partitions;
+    std::vector<Partition> partitions;
+    bool is_optimized = options.optimization_level != codegen::DefaultOptimization && options.optimization_level != codegen::O0;
+    if (utilities::get_cache_directory().has_value() && !is_optimized) {
+        std::vector<std::string> modules;
+        for (auto& it: ast.modules) {
+            modules.push_back(it.first);
+        }
+        std::sort(modules.begin(), modules.end());
+
+        for (auto& module: modules) {
+            auto cache_file = codegen::get_cached_object_file_path(ast, module, options);
+            if (cache_file.has_value()) {
+                auto object_file = take_cached_object_file(cache_file.value(), get_object_file_name(program_name + "-cached-" + std::to_string(object_files.size())));
+                if (object_file.has_value()) {
+                    object_files.push_back(object_file.value());
+                    continue;
+                }
+            }
 
-    // Generate object code
-    std::string object_file_name = get_object_file_name(program_name);
+            partitions.push_back(Partition {std::make_unique<codegen::Context>(ast, options.optimization_level, module), cache_file});
+            partitions.back().llvm_ir->codegen(ast);
+        }
+    }
+    else {
+        if (options.jobs > 1) function_partitions = get_function_partitions(ast, options.jobs);
+        for (size_t i = 0; i < options.jobs; i++) {
+            partitions.push_back(Partition {std::make_unique<codegen::Context>(ast, options.optimization_level, i, options.jobs)});
+            if (options.jobs > 1) partitions.back().llvm_ir->function_partitions = &function_partitions;
+            partitions.back().llvm_ir->codegen(ast);
+        }
+    }
 
-    std::error_code EC;
-    llvm::raw_fd_ostream dest(object_file_name, EC, llvm::sys::fs::OF_None);
+    std::atomic<size_t> next_partition = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(options.jobs, partitions.size()); i++) {
+        threads.push_back(std::thread([&partitions, &next_partition, options] {
+            std::unique_ptr<llvm::TargetMachine> target_machine(create_target_machine(options));
+            for (size_t i = next_partition++; i < partitions.size(); i = next_partition++) {
+                partitions[i].llvm_ir->optimize(target_machine.get());
 
-    if (EC) {
-        llvm::errs() << "Could not open file: " << EC.message();
+                llvm::raw_svector_ostream dest(partitions[i].buffer);
+                emit_file(partitions[i].llvm_ir->module, target_machine.get(), dest, llvm::CGFT_ObjectFile);
+            }
+        }));
     }
 
-    llvm::legacy::PassManager pass;
-    auto FileType = llvm::CGFT_ObjectFile;
-
-    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
-        llvm::errs() << "TargetMachine can't emit a file of this type";
+    for (auto& thread: threads) {
+        thread.join();
     }
 
-    pass.run(*(llvm_ir.module));
-    dest.flush();
+    for (size_t i = 0; i < partitions.size(); i++) {
+        auto& partition = partitions[i];
+        std::string object_file_name = i == 0 ? get_object_file_name(program_name) : get_object_file_name(program_name + "-" + std::to_string(i));
+        object_files.push_back(store_object_file(object_file_name, partition.buffer));
+        if (partition.cache_file.has_value()) {
+            object_files.back().is_cached = codegen::save_object_file_to_cache(partition.cache_file.value(), partition.buffer.data(), partition.buffer.size());
+        }
+    }
+    trace::record_peak_memory();
+    return object_files;
 }
 
 // Generate executable
 // -------------------
-void codegen::generate_executable(ast::Ast& ast, std::string program_name) {
-    codegen::generate_object_code(ast, program_name);
+Result<Ok, Error> codegen::generate_executable(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    auto object_files = generate_object_files(ast, program_name, options);
 
     // Link
-    link(utilities::get_executable_name(program_name), get_object_file_name(program_name), ast.link_with);
+    std::vector<std::string> object_file_paths;
+    for (auto& object_file: object_files) {
+        object_file_paths.push_back(object_file.path);
+    }
+    Result<Ok, Error> result;
+    {
+        trace::Span span("Link");
+        result = link(utilities::get_executable_name(program_name), object_file_paths, ast.link_with);
+    }
+
+    // Remove object files, the ones taken from the cache stay there
+    bool used_cache = false;
+    for (auto& object_file: object_files) {
+        used_cache = used_cache || object_file.is_cached;
+        remove_object_file(object_file);
+    }
+    if (used_cache) codegen::trim_object_cache();
+    return result;
+}
+
+// lld keeps global state, so only one program is linked at a time
+static std::mutex lld_mutex;
+
+// Run with JIT
+// ------------
+// The program is compiled in memory and its main is called from this
+// process, externs like printf and malloc are resolved against the
+// symbols of the compiler itself.
+bool codegen::run_with_jit(ast::Ast& ast, std::string program_name, codegen::Options options) {
+    codegen::Context llvm_ir(ast, options.optimization_level);
+    llvm_ir.codegen(ast);
+
+    codegen::initialize_targets();
+    std::unique_ptr<llvm::TargetMachine> target_machine(create_target_machine(options));
+    llvm_ir.optimize(target_machine.get());
+
+    // Create jit
+    auto jit = llvm::orc::LLJITBuilder().create();
+    if (!jit) {
+        llvm::errs() << llvm::toString(jit.takeError()) << "\n";
+        return false;
+    }
+
+    auto generator = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess((*jit)->getDataLayout().getGlobalPrefix());
+    if (!generator) {
+        llvm::errs() << llvm::toString(generator.takeError()) << "\n";
+        return false;
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+
+    // Add module, the jit takes ownership of the llvm context
+    delete llvm_ir.function_pass_manager;
+    delete llvm_ir.builder;
+    llvm_ir.function_pass_manager = nullptr;
+    llvm_ir.builder = nullptr;
+
+    llvm_ir.module->setDataLayout((*jit)->getDataLayout());
+    llvm::orc::ThreadSafeModule module(std::unique_ptr<llvm::Module>(llvm_ir.module), std::unique_ptr<llvm::LLVMContext>(llvm_ir.context));
+    llvm_ir.module = nullptr;
+    llvm_ir.context = nullptr;
+    if (auto error = (*jit)->addIRModule(std::move(module))) {
+        llvm::errs() << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+
+    // Run main
+    auto main = (*jit)->lookup("main");
+    if (!main) {
+        llvm::errs() << llvm::toString(main.takeError()) << "\n";
+        return false;
+    }
 
-    // Remove generated object file
-    remove(get_object_file_name(program_name).c_str());
+    auto main_function = (int (*)()) main->getAddress();
+    main_function();
+    fflush(stdout);
+    return true;
 }
 
 #ifdef __linux__
@@ -135,13 +443,15 @@ static std::string get_object_file_name(std::string executable_name) {
     return executable_name + ".o";
 }
 
-static void link(std::string executable_name, std::string object_file_name, std::vector<std::string> link_directives) {
+static Result<Ok, Error> link(std::string executable_name, std::vector<std::string> object_files, std::vector<std::string> link_directives) {
     std::string name = "-o" + executable_name;
 
     // Link using a native C compiler
     if (link_directives.size() > 0) {
         std::string build_command = "cc";
-        build_command += " " + object_file_name;
+        for (auto& object_file: object_files) {
+            build_command += " " + object_file;
+        }
         build_command += " " + name;
 
         // Add linker directives
@@ -153,19 +463,20 @@ static void link(std::string executable_name, std::string object_file_name, std:
         build_command += " -no-pie";
 
         // Execute command
-        system(build_command.c_str());
+        if (system(build_command.c_str()) != 0) return Error{"Linking with cc failed.\n"};
+        return Ok {};
     }
     // Link using lld
     else {
-         std::vector<std::string> args = {
-            "lld",
-            object_file_name,
+        std::vector<std::string> args = {"lld"};
+        args.insert(args.end(), object_files.begin(), object_files.end());
+        args.insert(args.end(), {
             name,
             utilities::get_folder_of_executable().string() + "/deps/musl/libc.a",
             utilities::get_folder_of_executable().string() + "/deps/musl/crt1.o",
             utilities::get_folder_of_executable().string() + "/deps/musl/crti.o",
             utilities::get_folder_of_executable().string() + "/deps/musl/crtn.o"
-        };
+        });
 
         std::string output = "";
         std::string errors = "";
@@ -176,10 +487,10 @@ static void link(std::string executable_name, std::string object_file_name, std:
         for (auto& arg: args) {
             args_as_c_strings.push_back(arg.c_str());
         }
+        std::lock_guard<std::mutex> lock(lld_mutex);
         bool result = lld::elf::link(args_as_c_strings, output_stream, errors_stream, false, false);
-        if (result == false) {
-            std::cout << errors;
-        }
+        if (result == false) return Error{errors};
+        return Ok {};
     }
 }
 #elif __APPLE__
@@ -191,11 +502,13 @@ static std::string get_object_file_name(std::string executable_name) {
     return executable_name + ".o";
 }
 
-static void link(std::string executable_name, std::string object_file_name, std::vector<std::string> link_directives) {
+static Result<Ok, Error> link(std::string executable_name, std::vector<std::string> object_files, std::vector<std::string> link_directives) {
     // Link using a native C compiler
     if (link_directives.size() > 0) {
         std::string build_command = "cc";
-        build_command += " " + object_file_name;
+        for (auto& object_file: object_files) {
+            build_command += " " + object_file;
+        }
         build_command += " -o " + executable_name;
 
         // Add linker directives
@@ -204,7 +517,8 @@ static void link(std::string executable_name, std::string object_file_name, std:
         }
 
         // Execute command
-        system(build_command.c_str());
+        if (system(build_command.c_str()) != 0) return Error{"Linking with cc failed.\n"};
+        return Ok {};
     }
 
     // Link using lld
@@ -215,14 +529,12 @@ static void link(std::string executable_name, std::string object_file_name, std:
         int osversion_name[] = { CTL_KERN, KERN_OSRELEASE };
 
         if (sysctl(osversion_name, 2, osversion, &osversion_len, NULL, 0) == -1) {
-            printf("sysctl() failed\n");
-            exit(EXIT_FAILURE);
+            return Error{"sysctl() failed\n"};
         }
 
         uint32_t major, minor;
         if (sscanf(osversion, "%u.%u", &major, &minor) != 2) {
-            printf("sscanf() failed\n");
-            exit(EXIT_FAILURE);
+            return Error{"sscanf() failed\n"};
         }
 
         if (major >= 20) {
@@ -244,8 +556,7 @@ static void link(std::string executable_name, std::string object_file_name, std:
             const char *command = "cc --print-file-name=libclang_rt.osx.a";
             FILE *fpipe =  (FILE*)popen(command, "r");
             if (!fpipe) {
-                perror("popen() failed.");
-                exit(EXIT_FAILURE);
+                return Error{"popen() failed.\n"};
             }
 
             char c;
@@ -268,8 +579,7 @@ static void link(std::string executable_name, std::string object_file_name, std:
             const char *command = "xcrun --show-sdk-path";
             FILE *fpipe =  (FILE*)popen(command, "r");
             if (!fpipe) {
-                perror("popen() failed.");
-                exit(EXIT_FAILURE);
+                return Error{"popen() failed.\n"};
             }
 
             char c;
@@ -281,9 +591,9 @@ static void link(std::string executable_name, std::string object_file_name, std:
         }
 
         // Create link args
-        std::vector<std::string> args = {
-            "lld",
-            object_file_name,
+        std::vector<std::string> args = {"lld"};
+        args.insert(args.end(), object_files.begin(), object_files.end());
+        args.insert(args.end(), {
             "-o",
             executable_name,
             "-arch",
@@ -297,7 +607,7 @@ static void link(std::string executable_name, std::string object_file_name, std:
             "-L/usr/local/lib",
             "-lSystem",
             libclang_rtx_location
-        };
+        });
 
         std::string output = "";
         std::string errors = "";
@@ -308,10 +618,10 @@ static void link(std::string executable_name, std::string object_file_name, std:
         for (auto& arg: args) {
             args_as_c_strings.push_back(arg.c_str());
         }
+        std::lock_guard<std::mutex> lock(lld_mutex);
         bool result = lld::macho::link(args_as_c_strings, output_stream, errors_stream, false, false);
-        if (result == false) {
-            std::cout << errors;
-        }
+        if (result == false) return Error{errors};
+        return Ok {};
     }
 }
 #endif
@@ -321,16 +631,18 @@ static std::string get_object_file_name(std::string executable_name) {
     return executable_name + ".obj";
 }
 
-static void link(std::string executable_name, std::string object_file_name, std::vector<std::string> link_directives) {
+static Result<Ok, Error> link(std::string executable_name, std::vector<std::string> object_files, std::vector<std::string> link_directives) {
     std::string name = "-out:" + executable_name;
-    std::vector<const char*> args = {
-        "lld",
-        object_file_name.c_str(),
+    std::vector<const char*> args = {"lld"};
+    for (auto& object_file: object_files) {
+        args.push_back(object_file.c_str());
+    }
+    args.insert(args.end(), {
         "-defaultlib:libcmt",
         "-defaultlib:oldnames",
         "-nologo",
         name.c_str()
-    };
+    });
 
     if (link_directives.size() > 0) {
         assert(false);
@@ -341,10 +653,10 @@ static void link(std::string executable_name, std::string object_file_name, std:
     llvm::raw_string_ostream output_stream(output);
     llvm::raw_string_ostream errors_stream(errors);
 
+    std::lock_guard<std::mutex> lock(lld_mutex);
     bool result = lld::coff::link(args, output_stream, errors_stream, false, false);
-    if (errors != "") {
-        std::cout << errors;
-    }
+    if (result == false) return Error{errors};
+    return Ok {};
 }
 #endif
 
@@ -352,7 +664,7 @@ static void link(std::string executable_name, std::string object_file_name, std:
 // -------
 
 // Constructor
-codegen::Context::Context(ast::Ast& ast) : ast(ast) {
+codegen::Context::Context(ast::Ast& ast, OptimizationLevel optimization_level, size_t partition, size_t partitions) : ast(ast), optimization_level(optimization_level), partition(partition), partitions(partitions) {
     this->current_module = ast.module_path;
     auto filename = ast.module_path.filename().string();
 
@@ -362,6 +674,7 @@ codegen::Context::Context(ast::Ast& ast) : ast(ast) {
     this->builder = new llvm::IRBuilder(*(this->context));
 
     // Add function pass optimizations
+    if (optimization_level != DefaultOptimization) return;
     this->function_pass_manager = new llvm::legacy::FunctionPassManager(this->module);
     this->function_pass_manager->add(llvm::createPromoteMemoryToRegisterPass());
     this->function_pass_manager->add(llvm::createInstructionCombiningPass());
@@ -371,14 +684,103 @@ codegen::Context::Context(ast::Ast& ast) : ast(ast) {
     this->function_pass_manager->doInitialization();
 }
 
+codegen::Context::~Context() {
+    delete this->function_pass_manager;
+    delete this->builder;
+    delete this->module;
+    delete this->context;
+}
+
+codegen::Context::Context(ast::Ast& ast, OptimizationLevel optimization_level, std::filesystem::path partition_module) : Context(ast, optimization_level) {
+    this->partition_module = partition_module;
+}
+
+// Partitions
+bool codegen::Context::owns_function_body(ast::FunctionNode* function) {
+    if (this->partition_module.empty()) {
+        if (this->function_partitions == nullptr) return true;
+        return this->function_partitions->at(function) == this->partition;
+    }
+
+    // Specializations depend on the whole program, so they go with it
+    if (function->state != ast::FunctionCompletelyTyped) {
+        return this->partition_module == this->ast.module_path;
+    }
+    return function->module_path == this->partition_module;
+}
+
+bool codegen::Context::owns_main_function() {
+    if (this->partition_module.empty()) return this->partition == 0;
+    return this->partition_module == this->ast.module_path;
+}
+
+// For the trace
+static std::string get_partition_name(const codegen::Context& context) {
+    if (!context.partition_module.empty()) return context.partition_module.string();
+    return "partition " + std::to_string(context.partition + 1) + " of " + std::to_string(context.partitions);
+}
+
+static llvm::OptimizationLevel as_llvm_optimization_level(codegen::OptimizationLevel optimization_level) {
+    switch (optimization_level) {
+        case codegen::O1: return llvm::OptimizationLevel::O1;
+        case codegen::O2: return llvm::OptimizationLevel::O2;
+        case codegen::O3: return llvm::OptimizationLevel::O3;
+        case codegen::Os: return llvm::OptimizationLevel::Os;
+        default: assert(false);
+    }
+    return llvm::OptimizationLevel::O0;
+}
+
+void codegen::Context::optimize(llvm::TargetMachine* target_machine) {
+    trace::Span span("Optimize", [&] {return get_partition_name(*this);});
+
+    // Functions say which cpu they are for, so the passes (like the inliner
+    // and the vectorizers) know what instructions they can use
+    if (target_machine->getTargetCPU() != "generic" || target_machine->getTargetFeatureString() != "") {
+        for (auto& function: this->module->functions()) {
+            if (function.isDeclaration()) continue;
+            function.addFnAttr("target-cpu", target_machine->getTargetCPU());
+            function.addFnAttr("target-features", target_machine->getTargetFeatureString());
+        }
+    }
+
+    if (this->optimization_level == DefaultOptimization) {
+        for (auto function: this->functions_to_optimize) {
+            this->function_pass_manager->run(*function);
+        }
+    }
+    else if (this->optimization_level != O0) {
+        // The target is needed to know the cost of instructions, for example
+        // to decide what to vectorize
+        this->module->setDataLayout(target_machine->createDataLayout());
+        this->module->setTargetTriple(target_machine->getTargetTriple().str());
+
+        llvm::LoopAnalysisManager loop_analysis_manager;
+        llvm::FunctionAnalysisManager function_analysis_manager;
+        llvm::CGSCCAnalysisManager cgscc_analysis_manager;
+        llvm::ModuleAnalysisManager module_analysis_manager;
+
+        llvm::PassBuilder pass_builder(target_machine);
+        pass_builder.registerModuleAnalyses(module_analysis_manager);
+        pass_builder.registerCGSCCAnalyses(cgscc_analysis_manager);
+        pass_builder.registerFunctionAnalyses(function_analysis_manager);
+        pass_builder.registerLoopAnalyses(loop_analysis_manager);
+        pass_builder.crossRegisterProxies(loop_analysis_manager, function_analysis_manager, cgscc_analysis_manager, module_analysis_manager);
+
+        llvm::ModulePassManager module_pass_manager = pass_builder.buildPerModuleDefaultPipeline(as_llvm_optimization_level(this->optimization_level));
+        module_pass_manager.run(*this->module, module_analysis_manager);
+    }
+
+    this->functions_to_optimize = {};
+}
 
 // Scope management
 void codegen::Context::add_scope() {
-    this->scopes.variable_scopes.push_back(std::unordered_map<std::string, Binding>());
+    this->scopes.variable_scopes.push_back(std::unordered_map<symbol::Symbol, Binding>());
 }
 
 void codegen::Context::add_scope(ast::BlockNode& block) {
-    this->scopes.variable_scopes.push_back(std::unordered_map<std::string, Binding>());
+    this->scopes.variable_scopes.push_back(std::unordered_map<symbol::Symbol, Binding>());
     auto result = this->scopes.functions_and_types_scopes.add_definitions_from_block_to_scope(this->ast, this->current_module, block);
     assert(result.is_ok());
 }
@@ -386,7 +788,7 @@ void codegen::Context::add_scope(ast::BlockNode& block) {
 codegen::Context::Scope codegen::Context::current_scope() {
     return codegen::Context::Scope {
         this->scopes.variable_scopes[this->scopes.variable_scopes.size() - 1],
-        this->scopes.functions_and_types_scopes.scopes[this->scopes.functions_and_types_scopes.scopes.size() - 1]
+        std::as_const(this->scopes.functions_and_types_scopes).current_scope()
     };
 }
 
@@ -496,10 +898,11 @@ void codegen::Context::remove_scope() {
     this->scopes.functions_and_types_scopes.remove_scope();
 }
 
-codegen::Context::Binding codegen::Context::get_binding(std::string identifier) {
+codegen::Context::Binding codegen::Context::get_binding(symbol::Symbol identifier) {
     for (auto scope = this->scopes.variable_scopes.rbegin(); scope != this->scopes.variable_scopes.rend(); scope++) {
-        if (scope->find(identifier) != scope->end()) {
-            return (*scope)[identifier];
+        auto it = scope->find(identifier);
+        if (it != scope->end()) {
+            return it->second;
         }
     }
     assert(false);
@@ -524,7 +927,7 @@ std::string codegen::Context::get_mangled_type_name(std::filesystem::path module
     return name;
 }
 
-std::string codegen::Context::get_mangled_function_name(std::filesystem::path module, std::string identifier, std::vector<ast::Type> args, ast::Type return_type, bool is_extern) {
+std::string codegen::Context::get_mangled_function_name(std::filesystem::path module, symbol::Symbol identifier, std::vector<ast::Type> args, ast::Type return_type, bool is_extern) {
     if (is_extern) {
         return identifier;
     }
@@ -563,7 +966,7 @@ std::string codegen::Context::get_mangled_function_name(std::filesystem::path mo
     }
     else if (binding->index() == ast::Function
     && std::get<ast::FunctionNode>(*binding).type_parameters.size() > 0) {
-        auto function = std::get<ast::FunctionNode>(*binding);
+        auto& function = std::get<ast::FunctionNode>(*binding);
         name += "[";
         for (size_t j = 0; j < function.type_parameters.size(); j++) {
             bool founded = false;
@@ -820,6 +1223,24 @@ ast::FunctionNode* codegen::Context::get_function(ast::CallNode* call) {
     return result;
 }
 
+llvm::Function* codegen::Context::get_llvm_function(ast::FunctionNode* function, ast::CallNode& node) {
+    std::vector<ast::Type> args = this->get_types(node.args);
+    ast::Type return_type = ast::get_concrete_type((ast::Node*) &node, this->type_bindings);
+
+    if (function->state != ast::FunctionCompletelyTyped) {
+        auto specialization = function->get_specialization(args, return_type);
+        auto it = this->specialization_prototypes.find(specialization);
+        if (it != this->specialization_prototypes.end()) return it->second;
+    }
+    else {
+        auto it = this->function_prototypes.find(function);
+        if (it != this->function_prototypes.end()) return it->second;
+    }
+
+    std::string name = this->get_mangled_function_name(function->module_path, node.identifier->value, args, return_type, function->is_extern);
+    return this->module->getFunction(name);
+}
+
 void codegen::Context::store_fields(ast::Node* expression, llvm::Value* struct_allocation) {
     // Get struct type
     llvm::StructType* struct_type = this->get_struct_type(ast::get_concrete_type(expression, this->type_bindings).as_nominal_type().type_definition);
@@ -1068,7 +1489,39 @@ llvm::Value* codegen::Context::create_heap_allocation(ast::Type type) {
 
 // Codegeneration
 // --------------
+// Modules and specializations are generated sorted, the order they were
+// added to the ast in depends on which modules came from the module cache
+// (see semantic/module_cache.hpp).
+static std::vector<std::pair<std::string, ast::BlockNode*>> get_modules_in_order(ast::Ast& ast) {
+    std::vector<std::pair<std::string, ast::BlockNode*>> modules(ast.modules.begin(), ast.modules.end());
+    std::sort(modules.begin(), modules.end(), [](auto& a, auto& b) {return a.first < b.first;});
+    return modules;
+}
+
+static std::string get_specialization_key(const ast::FunctionSpecialization& specialization) {
+    std::string key;
+    for (auto& arg: specialization.args) {
+        key += arg.to_str() + ",";
+    }
+    return key + specialization.return_type.to_str();
+}
+
+static std::vector<ast::FunctionSpecialization*> get_specializations_in_order(ast::FunctionNode& function) {
+    std::vector<std::pair<std::string, ast::FunctionSpecialization*>> keyed;
+    for (auto& specialization: function.specializations) {
+        keyed.push_back({get_specialization_key(specialization), &specialization});
+    }
+    std::sort(keyed.begin(), keyed.end(), [](auto& a, auto& b) {return a.first < b.first;});
+
+    std::vector<ast::FunctionSpecialization*> specializations;
+    for (auto& it: keyed) {
+        specializations.push_back(it.second);
+    }
+    return specializations;
+}
+
 void codegen::Context::codegen(ast::Ast& ast) {
+    trace::Span span("Generate LLVM IR", [&] {return get_partition_name(*this);});
     ast::BlockNode* node = (ast::BlockNode*) ast.program;
 
     // Declare malloc
@@ -1091,15 +1544,16 @@ void codegen::Context::codegen(ast::Ast& ast) {
     array_type->setBody(fields);
 
     // Codegen types
-    for (auto it = ast.modules.begin(); it != ast.modules.end(); it++) {
+    auto modules = get_modules_in_order(ast);
+    for (auto it = modules.begin(); it != modules.end(); it++) {
         this->codegen_types_prototypes(it->second->types);
     }
-    for (auto it = ast.modules.begin(); it != ast.modules.end(); it++) {
+    for (auto it = modules.begin(); it != modules.end(); it++) {
         this->codegen_types_bodies(it->second->types);
     }
 
     // Codegen functions
-    for (auto it = ast.modules.begin(); it != ast.modules.end(); it++) {
+    for (auto it = modules.begin(); it != modules.end(); it++) {
         this->current_module = it->first;
         this->add_scope(*it->second);
         this->codegen_function_prototypes(it->second->functions);
@@ -1107,7 +1561,7 @@ void codegen::Context::codegen(ast::Ast& ast) {
         this->scopes.functions_and_types_scopes.scopes = {};
         this->current_module = ast.module_path;
     }
-    for (auto it = ast.modules.begin(); it != ast.modules.end(); it++) {
+    for (auto it = modules.begin(); it != modules.end(); it++) {
         this->current_module = it->first;
         this->add_scope(*it->second);
         this->codegen_function_bodies(it->second->functions);
@@ -1116,6 +1570,9 @@ void codegen::Context::codegen(ast::Ast& ast) {
         this->current_module = ast.module_path;
     }
 
+    // The main function goes in the first partition, or the program's
+    if (!this->owns_main_function()) return;
+
     // Crate main function
     llvm::FunctionType* mainType = llvm::FunctionType::get(this->builder->getInt32Ty(), false);
     llvm::Function* main = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, "main", this->module);
@@ -1172,15 +1629,15 @@ void codegen::Context::codegen_function_prototypes(std::vector<ast::FunctionNode
         if (function->is_builtin) continue;
 
         if (function->state != ast::FunctionCompletelyTyped) {
-            for (auto& specialization: function->specializations) {
-                this->type_bindings = specialization.type_bindings;
+            for (auto specialization: get_specializations_in_order(*function)) {
+                this->type_bindings = specialization->type_bindings;
 
-                this->codegen_function_prototypes(
+                this->specialization_prototypes[specialization] = this->codegen_function_prototypes(
                     function->module_path,
                     function->identifier->value,
                     function->args,
-                    specialization.args,
-                    specialization.return_type,
+                    specialization->args,
+                    specialization->return_type,
                     function->is_extern,
                     function->is_extern_and_variadic
                 );
@@ -1191,7 +1648,7 @@ void codegen::Context::codegen_function_prototypes(std::vector<ast::FunctionNode
         else {
             if (!function->is_used) continue;
 
-            this->codegen_function_prototypes(
+            this->function_prototypes[function] = this->codegen_function_prototypes(
                 function->module_path,
                 function->identifier->value,
                 function->args,
@@ -1204,12 +1661,19 @@ void codegen::Context::codegen_function_prototypes(std::vector<ast::FunctionNode
     }
 }
 
-void codegen::Context::codegen_function_prototypes(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, bool is_extern, bool is_extern_and_variadic) {
+llvm::Function* codegen::Context::codegen_function_prototypes(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, bool is_extern, bool is_extern_and_variadic) {
     // Make function type
     llvm::FunctionType* function_type = this->get_function_type(args, args_types, return_type, is_extern_and_variadic);
 
     // Create function
     std::string name = this->get_mangled_function_name(module_path, identifier, ast::get_concrete_types(args_types, this->type_bindings), ast::get_concrete_type(return_type, this->type_bindings), is_extern);
+
+    // Extern functions can be declared by more than one module, all of them
+    // have to resolve to the same declaration
+    if (is_extern) {
+        if (llvm::Function* existing = this->module->getFunction(name)) return existing;
+    }
+
     llvm::Function* f = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, name, this->module);
 
     size_t offset = 0;
@@ -1240,6 +1704,8 @@ void codegen::Context::codegen_function_prototypes(std::filesystem::path module_
             f->getArg(i + offset)->setName(name);
         }
     }
+
+    return f;
 }
 
 void codegen::Context::codegen_function_bodies(std::vector<ast::FunctionNode*> functions) {
@@ -1247,15 +1713,15 @@ void codegen::Context::codegen_function_bodies(std::vector<ast::FunctionNode*> f
         if (function->is_extern || function->is_builtin) continue;
 
         if (function->state != ast::FunctionCompletelyTyped) {
-            for (auto& specialization: function->specializations) {
-                this->type_bindings = specialization.type_bindings;
+            for (auto specialization: get_specializations_in_order(*function)) {
+                if (!this->owns_function_body(function)) continue;
+                this->type_bindings = specialization->type_bindings;
 
                 this->codegen_function_bodies(
-                    function->module_path,
-                    function->identifier->value,
+                    this->specialization_prototypes[specialization],
                     function->args,
-                    specialization.args,
-                    specialization.return_type,
+                    specialization->args,
+                    specialization->return_type,
                     function->body
                 );
 
@@ -1264,10 +1730,10 @@ void codegen::Context::codegen_function_bodies(std::vector<ast::FunctionNode*> f
         }
         else {
             if (!function->is_used) continue;
+            if (!this->owns_function_body(function)) continue;
 
             this->codegen_function_bodies(
-                function->module_path,
-                function->identifier->value,
+                this->function_prototypes[function],
                 function->args,
                 ast::get_types(function->args),
                 function->return_type,
@@ -1277,9 +1743,9 @@ void codegen::Context::codegen_function_bodies(std::vector<ast::FunctionNode*> f
     }
 }
 
-void codegen::Context::codegen_function_bodies(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, ast::Node* function_body) {
-    std::string name = this->get_mangled_function_name(module_path, identifier, ast::get_concrete_types(args_types, this->type_bindings), ast::get_concrete_type(return_type, this->type_bindings), false);
-    llvm::Function* f = this->module->getFunction(name);
+void codegen::Context::codegen_function_bodies(llvm::Function* f, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, ast::Node* function_body) {
+    assert(f);
+    trace::Span span("Codegen function", [&] {return f->getName().str();});
 
     // Create the body of the function
     llvm::BasicBlock *body = llvm::BasicBlock::Create(*(this->context), "entry", f);
@@ -1307,7 +1773,7 @@ void codegen::Context::codegen_function_bodies(std::filesystem::path module_path
     }
 
     for (size_t i = 0; i < args.size(); i++) {
-        std::string name = args[i]->identifier->value;
+        symbol::Symbol name = args[i]->identifier->value;
 
         if (args[i]->is_mutable) {
             // Create allocation for argument
@@ -1363,7 +1829,7 @@ void codegen::Context::codegen_function_bodies(std::filesystem::path module_path
     }
     else {
         this->codegen(function_body);
-        if (return_type == ast::Type("None")) {
+        if (return_type == ast::Type("None") && !this->builder->GetInsertBlock()->getTerminator()) {
             this->builder->CreateRetVoid();
         }
     }
@@ -1371,8 +1837,8 @@ void codegen::Context::codegen_function_bodies(std::filesystem::path module_path
     // Verify function
     llvm::verifyFunction(*f);
 
-    // Run optimizations
-    this->function_pass_manager->run(*f);
+    // Optimizations are run later, see optimize
+    this->functions_to_optimize.push_back(f);
 
     // Remove arguments scope
     this->scopes.variable_scopes.pop_back();
@@ -1977,8 +2443,7 @@ llvm::Value* codegen::Context::codegen_call(ast::CallNode& node, std::optional<l
     }
     if (node.identifier->value == "print") {
         // Get function
-        std::string name = this->get_mangled_function_name(function->module_path, node.identifier->value, this->get_types(node.args), ast::get_concrete_type((ast::Node*) &node, this->type_bindings), function->is_extern);
-        llvm::Function* llvm_function = this->module->getFunction(name);
+        llvm::Function* llvm_function = this->get_llvm_function(function, node);
         assert(llvm_function);
 
         // Codegen args
@@ -2016,8 +2481,7 @@ llvm::Value* codegen::Context::codegen_call(ast::CallNode& node, std::optional<l
     }
 
     // Get function
-    std::string name = this->get_mangled_function_name(function->module_path, node.identifier->value, this->get_types(node.args), ast::get_concrete_type((ast::Node*) &node, this->type_bindings), function->is_extern);
-    llvm::Function* llvm_function = this->module->getFunction(name);
+    llvm::Function* llvm_function = this->get_llvm_function(function, node);
     assert(llvm_function);
 
     // Make call
@@ -2073,7 +2537,7 @@ llvm::Value* codegen::Context::codegen(ast::IdentifierNode& node) {
     return this->builder->CreateLoad(
         this->as_llvm_type(ast::get_concrete_type((ast::Node*) &node, this->type_bindings)),
         pointer,
-        node.value.c_str()
+        node.value.str().c_str()
     );
 }
 
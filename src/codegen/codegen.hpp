@@ -26,9 +26,14 @@
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/GVN.h"
 #include "llvm/Transforms/Utils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "lld/Common/Driver.h"
 
 #include "../ast.hpp"
+#include "../codegen.hpp"
 #include "../utilities.hpp"
 #include "../semantic.hpp"
 #include "../semantic/scopes.hpp"
@@ -46,7 +51,8 @@ namespace codegen {
         llvm::LLVMContext* context;
         llvm::Module* module;
         llvm::IRBuilder<>* builder;
-        llvm::legacy::FunctionPassManager* function_pass_manager;
+        llvm::legacy::FunctionPassManager* function_pass_manager = nullptr; // Only used with the default optimization level
+        OptimizationLevel optimization_level;
         llvm::BasicBlock* current_entry_block = nullptr; // Needed for doing stack allocations
         llvm::BasicBlock* last_after_while_block = nullptr; // Needed for break
         llvm::BasicBlock* last_while_block = nullptr; // Needed for continue
@@ -64,12 +70,12 @@ namespace codegen {
         };
 
         struct Scope {
-            std::unordered_map<std::string, Binding>& variables_scope;
-            semantic::FunctionsAndTypesScope& functions_and_types_scope;
+            std::unordered_map<symbol::Symbol, Binding>& variables_scope;
+            const semantic::FunctionsAndTypesScope& functions_and_types_scope;
         };
 
         struct Scopes {
-            std::vector<std::unordered_map<std::string, Binding>> variable_scopes;
+            std::vector<std::unordered_map<symbol::Symbol, Binding>> variable_scopes;
             semantic::FunctionsAndTypesScopes functions_and_types_scopes;
         };
 
@@ -77,8 +83,33 @@ namespace codegen {
         std::unordered_map<std::string, ast::Type> type_bindings;
         std::unordered_map<std::string, llvm::Constant*> globals;
 
-        // Constructor
-        Context(ast::Ast& ast);
+        // Partitions
+        // When generating code in parallel every partition declares all the
+        // functions but only defines its share of them, either the functions
+        // function_partitions assigns to it or the ones from partition_module
+        size_t partition = 0;
+        size_t partitions = 1;
+        const std::unordered_map<const ast::FunctionNode*, size_t>* function_partitions = nullptr; // Null if everything goes in one partition
+        std::filesystem::path partition_module; // Empty if not partitioned by module
+        std::vector<llvm::Function*> functions_to_optimize;
+
+        // Prototypes of the functions and specializations, so most calls
+        // don't need to build the mangled name
+        std::unordered_map<const ast::FunctionNode*, llvm::Function*> function_prototypes;
+        std::unordered_map<const ast::FunctionSpecialization*, llvm::Function*> specialization_prototypes;
+
+        // Constructor and destructor
+        // The context owns the llvm context, module, builder and pass manager
+        Context(ast::Ast& ast, OptimizationLevel optimization_level = DefaultOptimization, size_t partition = 0, size_t partitions = 1);
+        Context(ast::Ast& ast, OptimizationLevel optimization_level, std::filesystem::path partition_module);
+        ~Context();
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        // Partitions and optimization
+        bool owns_function_body(ast::FunctionNode* function);
+        bool owns_main_function();
+        void optimize(llvm::TargetMachine* target_machine);
 
         // Scope management
         void add_scope();
@@ -86,11 +117,11 @@ namespace codegen {
         Scope current_scope();
         void delete_binding(llvm::Value* pointer, ast::Type type);
         void remove_scope();
-        Binding get_binding(std::string identifier);
+        Binding get_binding(symbol::Symbol identifier);
 
         // Name mangling
         std::string get_mangled_type_name(std::filesystem::path module, std::string identifier);
-        std::string get_mangled_function_name(std::filesystem::path module, std::string identifier, std::vector<ast::Type> args, ast::Type return_type, bool is_extern);
+        std::string get_mangled_function_name(std::filesystem::path module, symbol::Symbol identifier, std::vector<ast::Type> args, ast::Type return_type, bool is_extern);
 
         // Types
         llvm::Type* as_llvm_type(ast::Type type);
@@ -108,6 +139,7 @@ namespace codegen {
 
         // Codegen helpers
         ast::FunctionNode* get_function(ast::CallNode* call);
+        llvm::Function* get_llvm_function(ast::FunctionNode* function, ast::CallNode& node);
         void store_fields(ast::Node* expression, llvm::Value* struct_allocation);
         void store_array_elements(ast::Node* expression, llvm::Value* array_allocation);
         llvm::Value* get_field_pointer(ast::FieldAccessNode& node);
@@ -128,9 +160,9 @@ namespace codegen {
         llvm::Value* codegen(ast::FunctionArgumentNode& node) {return nullptr;}
         llvm::Value* codegen(ast::FunctionNode& node) {return nullptr;}
         void codegen_function_prototypes(std::vector<ast::FunctionNode*> functions);
-        void codegen_function_prototypes(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, bool is_extern, bool is_extern_and_variadic);
+        llvm::Function* codegen_function_prototypes(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, bool is_extern, bool is_extern_and_variadic);
         void codegen_function_bodies(std::vector<ast::FunctionNode*> functions);
-        void codegen_function_bodies(std::filesystem::path module_path, std::string identifier, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, ast::Node* function_body);
+        void codegen_function_bodies(llvm::Function* f, std::vector<ast::FunctionArgumentNode*> args, std::vector<ast::Type> args_types, ast::Type return_type, ast::Node* function_body);
         llvm::Value* codegen(ast::InterfaceNode& node);
         llvm::Value* codegen(ast::DeclarationNode& node);
         llvm::Value* codegen(ast::AssignmentNode& node);
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "executable_cache.hpp"
+#include "../utilities.hpp"
+
+static const uintmax_t max_executable_cache_size = 512 * 1024 * 1024;
+
+std::optional<std::filesystem::path> codegen::get_cached_executable_path(ast::Ast& ast, codegen::Options options) {
+    auto directory = utilities::get_cache_directory();
+    if (!directory.has_value()) return std::nullopt;
+
+    // Program
+    uint64_t key = utilities::get_compiler_version();
+    key = utilities::hash_string(utilities::read_file(ast.module_path), key);
+
+    // Modules used, sorted so the key doesn't depend on the order they were
+    // parsed. Modules analyzed ahead (see semantic::load_prelude) are
+    // already in the ast.
+    std::vector<std::string> module_paths;
+    for (auto& it: ast.parsed_modules) {
+        module_paths.push_back(it.first);
+    }
+    for (auto& it: ast.modules) {
+        if (it.first != ast.module_path.string()) module_paths.push_back(it.first);
+    }
+    std::sort(module_paths.begin(), module_paths.end());
+    module_paths.erase(std::unique(module_paths.begin(), module_paths.end()), module_paths.end());
+
+    for (auto& module_path: module_paths) {
+        auto parsed = ast.parsed_modules.find(module_path);
+        key = utilities::hash_string(module_path, key);
+        key = utilities::hash_string(parsed != ast.parsed_modules.end() ? parsed->second.source : utilities::read_file(module_path), key);
+    }
+
+    // Codegen options, jobs doesn't change the executable
+    key = utilities::hash_value(options.optimization_level, key);
+
+    // Target, with "native" resolved so executables built for one cpu aren't
+    // reused on another one
+    auto target = codegen::get_target(options);
+    key = utilities::hash_string(target.triple, key);
+    key = utilities::hash_string(target.cpu, key);
+    key = utilities::hash_string(target.features, key);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+    return directory.value() / "executables" / name;
+}
+
+void codegen::trim_executable_cache() {
+    auto directory = utilities::get_cache_directory();
+    if (!directory.has_value()) return;
+    utilities::trim_cache_directory(directory.value() / "executables", max_executable_cache_size);
+}
@@ -0,0 +1,21 @@
+#ifndef CODEGEN_EXECUTABLE_CACHE_HPP
+#define CODEGEN_EXECUTABLE_CACHE_HPP
+
+#include <filesystem>
+#include <optional>
+
+#include "../ast.hpp"
+#include "../codegen.hpp"
+
+namespace codegen {
+    // Executables made by diamond run are saved in the cache directory, in a
+    // file named after the sources of the program and of every module it
+    // uses (std included), the compiler build and the codegen options.
+    //
+    // The modules must be parsed (see semantic::parse_modules) but not yet
+    // analyzed. Returns nullopt if there is no cache directory.
+    std::optional<std::filesystem::path> get_cached_executable_path(ast::Ast& ast, Options options);
+    void trim_executable_cache(); // Removes the executables used least recently if it's too big
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include "object_cache.hpp"
+#include "../semantic/intrinsics.hpp"
+#include "../utilities.hpp"
+
+static const uintmax_t max_object_cache_size = 512 * 1024 * 1024;
+
+std::optional<std::filesystem::path> codegen::get_cached_object_file_path(ast::Ast& ast, std::filesystem::path module_path, codegen::Options options) {
+    if (module_path == ast.module_path) return std::nullopt;
+
+    // Modules in an import cycle don't have a hash
+    auto module_hash = ast.module_hashes.find(module_path.string());
+    if (module_hash == ast.module_hashes.end()) return std::nullopt;
+
+    auto directory = utilities::get_cache_directory();
+    if (!directory.has_value()) return std::nullopt;
+
+    // Module
+    uint64_t key = utilities::get_compiler_version();
+    key = utilities::hash_value(module_hash->second, key);
+
+    // Symbols of modules outside std are named after their path relative
+    // to the program
+    if (!std_libs.contains(module_path)) {
+        key = utilities::hash_string(ast.module_path.parent_path().string(), key);
+    }
+
+    // Functions used, only those are generated
+    auto& functions = ast.modules[module_path.string()]->functions;
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (functions[i]->state == ast::FunctionCompletelyTyped && functions[i]->is_used) {
+            key = utilities::hash_value(i, key);
+        }
+    }
+
+    // Codegen options, jobs doesn't change the object file
+    key = utilities::hash_value(options.optimization_level, key);
+
+    // Target, with "native" resolved so object files built for one cpu aren't
+    // reused on another one
+    auto target = codegen::get_target(options);
+    key = utilities::hash_string(target.triple, key);
+    key = utilities::hash_string(target.cpu, key);
+    key = utilities::hash_string(target.features, key);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.o", (unsigned long long) key);
+    return directory.value() / "objects" / name;
+}
+
+bool codegen::save_object_file_to_cache(std::filesystem::path file, const char* data, size_t size) {
+    std::error_code error;
+    std::filesystem::create_directories(file.parent_path(), error);
+    if (error) return false;
+
+    // Write to a temporary file first so readers never see partial files
+    auto temporary = file;
+    temporary += ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream stream(temporary, std::ios::binary);
+        if (!stream.is_open()) return false;
+        stream.write(data, size);
+        if (!stream) {
+            stream.close();
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+void codegen::trim_object_cache() {
+    auto directory = utilities::get_cache_directory();
+    if (!directory.has_value()) return;
+    utilities::trim_cache_directory(directory.value() / "objects", max_object_cache_size);
+}
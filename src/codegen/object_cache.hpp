@@ -0,0 +1,27 @@
+#ifndef CODEGEN_OBJECT_CACHE_HPP
+#define CODEGEN_OBJECT_CACHE_HPP
+
+#include <filesystem>
+#include <optional>
+
+#include "../ast.hpp"
+#include "../codegen.hpp"
+
+namespace codegen {
+    // The object file of each module used by a program is saved in the
+    // cache directory, in a file named after the module and the modules it
+    // depends on (see ast::Ast::module_hashes), which of its functions are
+    // used, the compiler build and the codegen options. The program itself
+    // and the specializations of generic functions, that depend on the
+    // whole program, are compiled on every build. Only unoptimized builds
+    // use it, optimized builds compile the whole program in one llvm module
+    // so functions can be inlined across modules.
+    //
+    // Returns nullopt if the module can't be cached or there is no cache
+    // directory.
+    std::optional<std::filesystem::path> get_cached_object_file_path(ast::Ast& ast, std::filesystem::path module_path, Options options);
+    bool save_object_file_to_cache(std::filesystem::path file, const char* data, size_t size);
+    void trim_object_cache(); // Removes the object files used least recently if it's too big
+}
+
+#endif
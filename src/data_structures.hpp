@@ -1,13 +1,155 @@
 #ifndef DATA_STRUCTURES_HPP
 #define DATA_STRUCTURES_HPP
 
+#include <algorithm>
 #include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <utility>
+#include <cstdint>
 #include <cassert>
 
+// Hash
+// Used by Set and UnionFind, it's std::hash except for types std doesn't hash.
+template <typename T>
+struct Hash {
+    size_t operator()(const T& value) const {
+        return std::hash<T>()(value);
+    }
+};
+
+template <>
+struct Hash<std::filesystem::path> {
+    size_t operator()(const std::filesystem::path& path) const {
+        return std::filesystem::hash_value(path);
+    }
+};
+
+// Small vector
+// A vector that keeps its first N elements inline, so it only allocates
+// once it grows past them. It has the part of std::vector Set needs.
+template <typename T, size_t N>
+struct SmallVector {
+    T* items = (T*) this->storage;
+    size_t count = 0;
+    size_t capacity = N;
+    alignas(T) unsigned char storage[N * sizeof(T)];
+
+    SmallVector() {}
+    SmallVector(const SmallVector& other) {this->append(other);}
+    SmallVector(SmallVector&& other) {this->take(other);}
+    ~SmallVector() {
+        this->clear();
+        this->release();
+    }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this != &other) {
+            this->clear();
+            this->append(other);
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) {
+        if (this != &other) {
+            this->clear();
+            this->release();
+            this->take(other);
+        }
+        return *this;
+    }
+
+    size_t size() const {return this->count;}
+    bool empty() const {return this->count == 0;}
+    T* begin() {return this->items;}
+    T* end() {return this->items + this->count;}
+    const T* begin() const {return this->items;}
+    const T* end() const {return this->items + this->count;}
+    T& operator[](size_t index) {return this->items[index];}
+    const T& operator[](size_t index) const {return this->items[index];}
+    T& back() {return this->items[this->count - 1];}
+    const T& back() const {return this->items[this->count - 1];}
+
+    // Takes the element by value, it can be one of the elements moved when growing
+    void push_back(T element) {
+        if (this->count == this->capacity) this->reserve(this->capacity * 2);
+        new (this->items + this->count) T(std::move(element));
+        this->count++;
+    }
+
+    T* erase(T* position) {
+        std::move(position + 1, this->end(), position);
+        this->count--;
+        this->items[this->count].~T();
+        return position;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < this->count; i++) {
+            this->items[i].~T();
+        }
+        this->count = 0;
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity <= this->capacity) return;
+
+        T* items = (T*) ::operator new(capacity * sizeof(T));
+        for (size_t i = 0; i < this->count; i++) {
+            new (items + i) T(std::move(this->items[i]));
+            this->items[i].~T();
+        }
+        this->release();
+        this->items = items;
+        this->capacity = capacity;
+    }
+
+    bool is_inline() const {return this->items == (const T*) this->storage;}
+
+    // Frees the heap storage, the elements must have been destroyed
+    void release() {
+        if (!this->is_inline()) ::operator delete(this->items);
+        this->items = (T*) this->storage;
+        this->capacity = N;
+    }
+
+    void append(const SmallVector& other) {
+        this->reserve(this->count + other.count);
+        for (auto& element: other) this->push_back(element);
+    }
+
+    // Must be empty and inline
+    void take(SmallVector& other) {
+        if (other.is_inline()) {
+            for (auto& element: other) this->push_back(std::move(element));
+            other.clear();
+            return;
+        }
+
+        this->items = other.items;
+        this->count = other.count;
+        this->capacity = other.capacity;
+        other.items = (T*) other.storage;
+        other.count = 0;
+        other.capacity = N;
+    }
+};
+
 // Set
+// Elements are kept in insertion order in `elements`, which can be read
+// directly but must only be modified through the methods. Most sets have
+// 4 elements or less, those are kept inline without allocating. Small sets
+// are searched linearly, bigger ones get an open addressing index into
+// `elements` so insert and contains stay O(1).
 template <typename T>
 struct Set {
-    std::vector<T> elements;
+    SmallVector<T, 4> elements;
+    std::vector<uint32_t> slots; // Index into elements plus one, 0 is empty
+
+    static const size_t small_size = 8;
 
     Set() {}
     
@@ -17,76 +159,162 @@ struct Set {
         }
     }
 
-    void insert(T element) {
-        for (size_t i = 0; i < this->elements.size(); i++) {
-            if (this->elements[i] == element) {
-                return;
-            }
-        }
+    void insert(const T& element) {
+        if (this->contains(element)) return;
+
         this->elements.push_back(element);
+        if (this->slots.size() != 0 && this->elements.size() * 2 <= this->slots.size()) {
+            this->add_to_index(this->elements.size() - 1);
+        }
+        else if (this->elements.size() > small_size) {
+            this->rebuild_index();
+        }
     }
 
-    void remove(T element) {
-        for (size_t i = 0; i < this->elements.size(); i++) {
-            if (this->elements[i] == element) {
-                this->elements.erase(this->elements.begin() + i);
-                return;
-            }
-        }
-        assert(false);
+    void remove(const T& element) {
+        size_t index = this->find(element);
+        assert(index != this->elements.size());
+        this->elements.erase(this->elements.begin() + index);
+        this->rebuild_index();
     }
 
-    bool contains(T element) {
-        for (size_t i = 0; i < this->elements.size(); i++) {
-            if (this->elements[i] == element) return true;
-        }
-        return false;
+    bool contains(const T& element) const {
+        return this->find(element) != this->elements.size();
     }
 
     size_t size() const {
         return this->elements.size();
     }
 
-    void merge(Set<T> b) {
+    void merge(const Set<T>& b) {
         for (size_t i = 0; i < b.elements.size(); i++) {
             this->insert(b.elements[i]);
         }
     }
 
-    Set<T> intersect(Set<T> b) {
+    Set<T> intersect(const Set<T>& b) const {
         Set<T> intersection;
         for (auto& element: this->elements) {
             if (b.contains(element)) {
-                intersection.elements.push_back(element);
+                intersection.insert(element);
             }
         }
         return intersection;
     }
+
+    // Returns the position of the element or size() if it isn't in the set
+    size_t find(const T& element) const {
+        if (this->slots.size() == 0) {
+            for (size_t i = 0; i < this->elements.size(); i++) {
+                if (this->elements[i] == element) return i;
+            }
+            return this->elements.size();
+        }
+
+        size_t mask = this->slots.size() - 1;
+        for (size_t slot = Hash<T>()(element) & mask; this->slots[slot] != 0; slot = (slot + 1) & mask) {
+            if (this->elements[this->slots[slot] - 1] == element) return this->slots[slot] - 1;
+        }
+        return this->elements.size();
+    }
+
+    void add_to_index(size_t index) {
+        size_t mask = this->slots.size() - 1;
+        size_t slot = Hash<T>()(this->elements[index]) & mask;
+        while (this->slots[slot] != 0) slot = (slot + 1) & mask;
+        this->slots[slot] = (uint32_t) index + 1;
+    }
+
+    void rebuild_index() {
+        if (this->elements.size() <= small_size) {
+            this->slots = {};
+            return;
+        }
+
+        size_t capacity = 16;
+        while (capacity < this->elements.size() * 4) capacity *= 2;
+        this->slots.assign(capacity, 0);
+        for (size_t i = 0; i < this->elements.size(); i++) {
+            this->add_to_index(i);
+        }
+    }
 };
 
+// Union find
+// Disjoint sets with path compression and union by size. Elements are
+// remembered in insertion order so results don't depend on hashing.
 template <typename T>
-std::vector<Set<T>> merge_sets_with_shared_elements(std::vector<Set<T>> sets) {
-    size_t i = 0;
-    while (i < sets.size()) {
-        bool merged = false;
-
-        for (size_t j = i + 1; j < sets.size(); j++) {
-            Set<T> intersection = sets[i].intersect(sets[j]);
-            if (intersection.size() != 0) {
-                // Merge sets
-                sets[i].merge(sets[j]);
-
-                // Erase duplicated set
-                sets.erase(sets.begin() + j);
-                merged = true;
-                break;
+struct UnionFind {
+    std::vector<T> elements;
+    std::vector<size_t> parents;
+    std::vector<size_t> sizes;
+    std::unordered_map<T, size_t, Hash<T>> indices;
+
+    size_t insert(const T& element) {
+        auto it = this->indices.find(element);
+        if (it != this->indices.end()) return it->second;
+
+        size_t index = this->elements.size();
+        this->elements.push_back(element);
+        this->parents.push_back(index);
+        this->sizes.push_back(1);
+        this->indices[element] = index;
+        return index;
+    }
+
+    size_t find(size_t index) {
+        while (this->parents[index] != index) {
+            this->parents[index] = this->parents[this->parents[index]];
+            index = this->parents[index];
+        }
+        return index;
+    }
+
+    void merge(size_t a, size_t b) {
+        a = this->find(a);
+        b = this->find(b);
+        if (a == b) return;
+        if (this->sizes[a] < this->sizes[b]) std::swap(a, b);
+        this->parents[b] = a;
+        this->sizes[a] += this->sizes[b];
+    }
+
+    // Sets are ordered by their first inserted element, and elements inside
+    // each set keep insertion order too.
+    std::vector<Set<T>> get_sets() {
+        std::vector<Set<T>> sets;
+        std::unordered_map<size_t, size_t> set_of_root;
+        for (size_t i = 0; i < this->elements.size(); i++) {
+            size_t root = this->find(i);
+            auto it = set_of_root.find(root);
+            if (it == set_of_root.end()) {
+                it = set_of_root.insert({root, sets.size()}).first;
+                sets.push_back(Set<T>());
             }
+            sets[it->second].elements.push_back(this->elements[i]);
         }
 
-        if (!merged) i++;
+        // Elements are already unique, so they are pushed directly and big
+        // sets get their index once they are complete
+        for (auto& set: sets) {
+            set.rebuild_index();
+        }
+        return sets;
     }
+};
+
+template <typename T>
+std::vector<Set<T>> merge_sets_with_shared_elements(const std::vector<Set<T>>& sets) {
+    UnionFind<T> union_find;
+    for (auto& set: sets) {
+        if (set.size() == 0) continue;
 
-    return sets;
+        size_t first = union_find.insert(set.elements[0]);
+        for (size_t i = 1; i < set.elements.size(); i++) {
+            union_find.merge(first, union_find.insert(set.elements[i]));
+        }
+    }
+    return union_find.get_sets();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "diamond.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic.hpp"
+
+diamond::Compilation::Compilation(std::filesystem::path file, codegen::Options options) : options(options) {
+    // Relative paths would depend on the working directory of the process
+    std::error_code error;
+    this->file = std::filesystem::absolute(file, error);
+    if (error) this->file = file;
+    this->program_name = (this->file.parent_path() / this->file.stem()).string();
+}
+
+diamond::Compilation::~Compilation() {
+    this->ast.free();
+}
+
+bool diamond::Compilation::analyze() {
+    if (this->is_analyzed) return this->diagnostics.size() == 0;
+    this->is_analyzed = true;
+
+    // Lex
+    auto lexing_result = lexer::lex(this->file);
+    if (lexing_result.is_error()) {
+        for (auto& error: lexing_result.get_error()) {
+            this->diagnostics.push_back(error.value);
+        }
+        return false;
+    }
+
+    // Parse
+    auto parsing_result = parse::program(lexing_result.get_value(), this->file);
+    if (parsing_result.is_error()) {
+        for (auto& error: parsing_result.get_error()) {
+            this->diagnostics.push_back(error.value);
+        }
+        return false;
+    }
+    this->ast = parsing_result.get_value();
+
+    // Analyze
+    auto analyze_result = semantic::analyze(this->ast);
+    if (analyze_result.is_error()) {
+        for (auto& error: analyze_result.get_error()) {
+            this->diagnostics.push_back(error.value);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool diamond::Compilation::build() {
+    if (!this->analyze()) return false;
+
+    auto result = codegen::generate_executable(this->ast, this->program_name, this->options);
+    if (result.is_error()) {
+        this->diagnostics.push_back(result.get_error().value);
+        return false;
+    }
+
+    return true;
+}
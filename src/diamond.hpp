@@ -0,0 +1,35 @@
+#ifndef DIAMOND_HPP
+#define DIAMOND_HPP
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "codegen.hpp"
+
+namespace diamond {
+    // The compiler as a library (libdiamond). A compilation owns the ast of
+    // its program, the llvm modules generated from it and its diagnostics,
+    // so different compilations can run at the same time on different
+    // threads. Errors are added to diagnostics instead of being printed,
+    // and the process is never exited.
+    struct Compilation {
+        std::filesystem::path file;
+        std::string program_name; // The executable is named after it, by default the program without extension
+        codegen::Options options;
+        ast::Ast ast;
+        bool is_analyzed = false;
+        std::vector<std::string> diagnostics;
+
+        Compilation(std::filesystem::path file, codegen::Options options = codegen::Options{});
+        Compilation(const Compilation&) = delete;
+        Compilation& operator=(const Compilation&) = delete;
+        ~Compilation();
+
+        bool analyze(); // Lexes, parses and analyzes the program
+        bool build();   // Analyzes the program if needed and generates the executable
+    };
+}
+
+#endif
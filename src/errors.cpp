@@ -25,10 +25,25 @@ std::string underline_identifier(ast::IdentifierNode& identifier, std::filesyste
 // Implementantions
 // ----------------
 std::string errors::usage() {
-    return make_header("diamond build [program file]\n") +
-                     "    Creates a native executable from the program.\n\n" +
-           make_header("diamond run [program file]\n") +
-                     "    Runs the program.\n\n" +
+    return make_header("diamond build [options] [program file]\n") +
+                     "    Creates a native executable from the program.\n\n"
+                     "    With --batch many program files and directories\n"
+                     "    can be given, each one is built next to its file\n"
+                     "    and --jobs says how many are built at once.\n\n" +
+           make_header("diamond run [options] [program file]\n") +
+                     "    Runs the program. With --jit the program is compiled\n"
+                     "    in memory and run inside the compiler process.\n\n" +
+                     "    The options for build and run are:\n"
+                     "        --jobs N    Optimize and emit code using N threads\n"
+                     "        -O0, -O1, -O2, -O3, -Os\n"
+                     "                    Optimization level, -O0 compiles fastest\n"
+                     "        --target-cpu=<name|native>\n"
+                     "                    CPU to generate code for, generic by default\n"
+                     "        --target-features=<features>\n"
+                     "                    CPU features to enable or disable, like +avx2,-fma\n"
+                     "        --time-trace[=<file>]\n"
+                     "                    Write where compile time goes as a Chrome trace,\n"
+                     "                    to <program>.trace.json by default\n\n" +
            make_header("diamond emit [options] [program file]\n") +
                        "    This command emits intermediary representations of\n"
                        "    the program. Is useful for debugging the compiler.\n\n"
@@ -39,7 +54,14 @@ std::string errors::usage() {
                        "        --ast-with-concrete-types\n"
                        "        --llvm-ir\n"
                        "        --assembly\n"
-                       "        --object-code\n";
+                       "        --object-code\n"
+                       "        --target (triple, cpu and features)\n\n"
+                       "    The optimization levels, target options and --time-trace\n"
+                       "    can be passed too.\n\n" +
+           make_header("diamond server [socket file]\n") +
+                       "    Keeps a compiler running to make the other commands\n"
+                       "    start faster. They use it when DIAMOND_SERVER has the\n"
+                       "    path of the socket file, which is also the default.\n";
 }
 
 std::string errors::generic_error(Location location, std::string message) {
@@ -142,6 +164,11 @@ std::string errors::file_couldnt_be_found(std::filesystem::path path) {
            "\"" + path.string() + "\"" + " couldn't be found." + "\n";
 }
 
+std::string errors::server_couldnt_start(std::filesystem::path socket_path, std::string reason) {
+    return make_header("Server couldn't start\n\n") +
+           "\"" + socket_path.string() + "\": " + reason + "\n";
+}
+
 int number_of_digits(size_t number) {
     int digits = 0;
     while (number != 0) {
@@ -239,7 +266,7 @@ std::string underline_identifier(ast::IdentifierNode& identifier, std::filesyste
         else                        result += " ";
         col += 1;
     }
-    for (size_t i = 0; i < identifier.value.size(); i++) {
+    for (size_t i = 0; i < identifier.value.str().size(); i++) {
         result += make_red("^");
     }
     return result;
@@ -20,6 +20,7 @@ namespace errors {
     std::string undefined_function(ast::CallNode& call, std::vector<ast::Type> args, std::filesystem::path file);
     std::string unhandled_return_value(ast::CallNode& call, std::filesystem::path file);
     std::string file_couldnt_be_found(std::filesystem::path path);
+    std::string server_couldnt_start(std::filesystem::path socket_path, std::string reason);
 }
 
 #endif
@@ -1,11 +1,14 @@
 #include <cctype>
+#include <cstring>
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <stack>
 
 #include "tokens.hpp"
 #include "lexer.hpp"
 #include "errors.hpp"
+#include "trace.hpp"
 
 // Prototypes and definitions
 // --------------------------
@@ -18,32 +21,39 @@ namespace lexer {
     struct Source {
         size_t line;
         size_t column;
-        size_t index;
         std::filesystem::path path;
-        FILE* file_pointer;
+        const char* begin;
+        const char* position;
+        const char* end;
         std::stack<OnString> onString;
 
         Source() {}
-        Source(std::filesystem::path path, FILE* file_pointer) : line(1), column(1), index(0), path(path), file_pointer(file_pointer) {}
+        Source(std::filesystem::path path, const std::string& buffer) : line(1), column(1), path(path), begin(buffer.data()), position(buffer.data()), end(buffer.data() + buffer.size()) {}
     };
 
-    char current(Source source) {
-        char c = fgetc(source.file_pointer);
-        if (c == EOF) fseek(source.file_pointer, 0, SEEK_END);
-        else          fseek(source.file_pointer, -1, SEEK_CUR);
-        return c;
+    size_t offset(const Source& source) {
+        return source.position - source.begin;
+    }
+
+    bool at_end(const Source& source) {
+        return source.position >= source.end;
+    }
+
+    char current(const Source& source) {
+        if (at_end(source)) return EOF;
+        return *source.position;
     }
 
     void advance(Source& source) {
-        if (current(source) == '\n') {
+        if (at_end(source)) return;
+        if (*source.position == '\n') {
             source.line += 1;
             source.column = 1;
         }
         else {
             source.column++;
         }
-        source.index++;
-        fgetc(source.file_pointer);
+        source.position++;
     }
 
     void advance(Source& source, unsigned int offset) {
@@ -53,108 +63,82 @@ namespace lexer {
         }
     }
 
-    char prev(Source source) {
-        int result = fseek(source.file_pointer, -1, SEEK_CUR);
-        if (result < 0) return '\n';
-        char c = current(source);
-        advance(source);
-        return c;
-    }
-
-    char peek(Source source, unsigned int offset = 1);
-    char peek(Source source, unsigned int offset) {
-        unsigned int aux = offset;
-        while (aux > 0) {
-            char c = fgetc(source.file_pointer);
-            if (c == EOF) {
-                fseek(source.file_pointer, -(int)(offset - aux), SEEK_CUR);
-            }
-            aux--;
-        }
-        char c = current(source);
-        fseek(source.file_pointer, -(int)offset, SEEK_CUR);
-        return c;
-    }
-
-    bool at_end(Source source) {
-        return current(source) == EOF;
+    char peek(const Source& source, unsigned int offset = 1);
+    char peek(const Source& source, unsigned int offset) {
+        if ((size_t)(source.end - source.position) <= offset) return EOF;
+        return source.position[offset];
     }
 
-    bool match(Source source, std::string to_match) {
-        bool match = true;
-        int i = 0;
-        while (!at_end(source) && i < to_match.size()) {
-            if (current(source) != to_match[i]) {
-                match = false;
-                break;
-            }
-            advance(source);
-            i++;
-        }
-        if (at_end(source) && i != to_match.size()) {
-            match = false;
-        }
-        fseek(source.file_pointer, -i, SEEK_CUR);
-        return match;
+    bool match(const Source& source, const char* to_match) {
+        size_t size = strlen(to_match);
+        if ((size_t)(source.end - source.position) < size) return false;
+        return memcmp(source.position, to_match, size) == 0;
     }
 
     Result<token::Token, Error> get_token(Source& source);
-    Result<token::Token, Error> advance(token::Token token, Source& source, unsigned int offset);
+    Result<token::Token, Error> advance(token::TokenVariant variant, Source& source, unsigned int length);
     void advance_until_new_line(Source& source);
     Result<token::Token, Error> get_string(Source& source);
     Result<token::Token, Error> get_number(Source& source);
     Result<token::Token, Error> get_identifier(Source& source);
-    std::string get_integer(Source& source);
+    void get_integer(Source& source);
     Result<token::Token, Error> get_indent(Source& source);
 }
 
 // Lexing
 // ------
-Result<std::vector<token::Token>, Errors> lexer::lex(std::filesystem::path path) {
-     std::vector<token::Token> tokens;
-     Errors errors;
-
-    // Read file
-    FILE* file_pointer = fopen(path.string().c_str(), "rb");
-    if (!file_pointer) {
-        errors.push_back(errors::file_couldnt_be_found(path));
-        return Result<std::vector<token::Token>, Errors>(errors);
+Result<token::Tokens, Errors> lexer::lex(std::filesystem::path path) {
+    // Read whole file at once
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return Result<token::Tokens, Errors>(Errors{errors::file_couldnt_be_found(path)});
     }
 
+    std::string buffer;
+    buffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+    file.close();
+
+    return lexer::lex(std::move(buffer), path);
+}
+
+Result<token::Tokens, Errors> lexer::lex(std::string buffer, std::filesystem::path path) {
+    trace::Span span("Lex", [&] {return path.string();});
+    token::Tokens tokens(std::move(buffer));
+    Errors errors;
+
     // Create source
-    Source source(path, file_pointer);
+    Source source(path, tokens.source);
 
     // Tokenize
     while (!at_end(source)) {
         auto result = get_token(source);
         if (result.is_ok() && result.get_value() != token::EndOfFile) {
-            tokens.push_back(result.get_value());
+            tokens.tokens.push_back(result.get_value());
         }
         else if (result.is_error()) {
             errors.push_back(result.get_error());
             advance(source);
         }
     }
-    tokens.push_back(token::Token(token::EndOfFile, source.line, source.column));
-
-    // Close file
-    fclose(file_pointer);
+    tokens.tokens.push_back(token::Token(token::EndOfFile, offset(source), 0, source.line, source.column));
 
-    if (errors.size() != 0) return Result<std::vector<token::Token>, Errors>(errors);
-    else                    return Result<std::vector<token::Token>, Errors>(tokens);
+    if (errors.size() != 0) return Result<token::Tokens, Errors>(errors);
+    else                    return Result<token::Tokens, Errors>(std::move(tokens));
 }
 
 Result<token::Token, Error> lexer::get_token(Source& source) {
-    if (at_end(source))      return advance(token::Token(token::EndOfFile, "EndOfFile", source.line, source.column), source, 1);
-    if (match(source, "("))  return advance(token::Token(token::LeftParen, "(", source.line, source.column), source, 1);
-    if (match(source, ")"))  return advance(token::Token(token::RightParen, ")", source.line, source.column), source, 1);
-    if (match(source, "["))  return advance(token::Token(token::LeftBracket, "[", source.line, source.column), source, 1);
-    if (match(source, "]"))  return advance(token::Token(token::RightBracket, "]", source.line, source.column), source, 1);
+    if (at_end(source))      return advance(token::EndOfFile, source, 0);
+    if (match(source, "("))  return advance(token::LeftParen, source, 1);
+    if (match(source, ")"))  return advance(token::RightParen, source, 1);
+    if (match(source, "["))  return advance(token::LeftBracket, source, 1);
+    if (match(source, "]"))  return advance(token::RightBracket, source, 1);
     if (match(source, "{"))  {
         if (!source.onString.empty()) {
             source.onString.push(OnString{'{', false});
         }
-        return advance(token::Token(token::LeftCurly, "{", source.line, source.column), source, 1);
+        return advance(token::LeftCurly, source, 1);
     }
     if (match(source, "}")) {
         if (!source.onString.empty()
@@ -164,32 +148,32 @@ Result<token::Token, Error> lexer::get_token(Source& source) {
             }
             else {
                 source.onString.pop();
-                return advance(token::Token(token::RightCurly, "}", source.line, source.column), source, 1);
+                return advance(token::RightCurly, source, 1);
             }
         }
 
-        return advance(token::Token(token::RightCurly, "}", source.line, source.column), source, 1);
+        return advance(token::RightCurly, source, 1);
     }
-    if (match(source, "+"))  return advance(token::Token(token::Plus, "+", source.line, source.column), source, 1);
-    if (match(source, "*"))  return advance(token::Token(token::Star, "*", source.line, source.column), source, 1);
-    if (match(source, "/"))  return advance(token::Token(token::Slash, "/", source.line, source.column), source, 1);
-    if (match(source, "%"))  return advance(token::Token(token::Modulo, "%", source.line, source.column), source, 1);
-    if (match(source, ":=")) return advance(token::Token(token::ColonEqual, ":=", source.line, source.column), source, 2);
-    if (match(source, ":"))  return advance(token::Token(token::Colon, ":", source.line, source.column), source, 1);
-    if (match(source, ","))  return advance(token::Token(token::Comma, ",", source.line, source.column), source, 1);
-    if (match(source, "!=")) return advance(token::Token(token::NotEqual, "!=", source.line, source.column), source, 2);
-    if (match(source, "==")) return advance(token::Token(token::EqualEqual, "==", source.line, source.column), source, 2);
-    if (match(source, "="))  return advance(token::Token(token::Equal, "=", source.line, source.column), source, 1);
-    if (match(source, ">=")) return advance(token::Token(token::GreaterEqual, ">=", source.line, source.column), source, 2);
-    if (match(source, ">"))  return advance(token::Token(token::Greater, ">", source.line, source.column), source, 1);
-    if (match(source, "<=")) return advance(token::Token(token::LessEqual, "<=", source.line, source.column), source, 2);
-    if (match(source, "<"))  return advance(token::Token(token::Less, "<", source.line, source.column), source, 1);
-    if (match(source, "&"))  return advance(token::Token(token::Ampersand, "&", source.line, source.column), source, 1);
+    if (match(source, "+"))  return advance(token::Plus, source, 1);
+    if (match(source, "*"))  return advance(token::Star, source, 1);
+    if (match(source, "/"))  return advance(token::Slash, source, 1);
+    if (match(source, "%"))  return advance(token::Modulo, source, 1);
+    if (match(source, ":=")) return advance(token::ColonEqual, source, 2);
+    if (match(source, ":"))  return advance(token::Colon, source, 1);
+    if (match(source, ","))  return advance(token::Comma, source, 1);
+    if (match(source, "!=")) return advance(token::NotEqual, source, 2);
+    if (match(source, "==")) return advance(token::EqualEqual, source, 2);
+    if (match(source, "="))  return advance(token::Equal, source, 1);
+    if (match(source, ">=")) return advance(token::GreaterEqual, source, 2);
+    if (match(source, ">"))  return advance(token::Greater, source, 1);
+    if (match(source, "<=")) return advance(token::LessEqual, source, 2);
+    if (match(source, "<"))  return advance(token::Less, source, 1);
+    if (match(source, "&"))  return advance(token::Ampersand, source, 1);
     if (match(source, ".") && isdigit(peek(source))) {
         return get_number(source);
     }
     if (match(source, ".")) {
-        return advance(token::Token(token::Dot, ".", source.line, source.column), source, 1);
+        return advance(token::Dot, source, 1);
     }
     if (match(source, "---")) {
         advance(source, 3);
@@ -208,21 +192,19 @@ Result<token::Token, Error> lexer::get_token(Source& source) {
         return get_token(source);
     }
     if (match(source, "-")) {
-        return advance(token::Token(token::Minus, "-", source.line, source.column), source, 1);
+        return advance(token::Minus, source, 1);
     }
     if (match(source, "_")) {
         return get_identifier(source);
     }
-    if (match(source, " "))  {
-        advance(source);
-        return get_token(source);
-    }
-    if (match(source, "\t")) {
-        advance(source);
+    if (match(source, " ") || match(source, "\t")) {
+        while (match(source, " ") || match(source, "\t")) {
+            advance(source);
+        }
         return get_token(source);
     }
-    if (match(source, "\r\n"))    return advance(token::Token(token::NewLine, "\\n", source.line, source.column), source, 2);
-    if (match(source, "\n"))      return advance(token::Token(token::NewLine, "\\n", source.line, source.column), source, 1);
+    if (match(source, "\r\n"))    return advance(token::NewLine, source, 2);
+    if (match(source, "\n"))      return advance(token::NewLine, source, 1);
     if (match(source, "\""))      return get_string(source);
     if (isdigit(current(source))) return get_number(source);
     if (isalpha(current(source))) return get_identifier(source);
@@ -230,8 +212,9 @@ Result<token::Token, Error> lexer::get_token(Source& source) {
     return Result<token::Token, Error>(std::string("Error: Unrecognized character \"") + std::string(1, current(source)) + std::string("\".\n"));
 }
 
-Result<token::Token, Error> lexer::advance(token::Token token, Source& source, unsigned int offset) {
-    advance(source, offset);
+Result<token::Token, Error> lexer::advance(token::TokenVariant variant, Source& source, unsigned int length) {
+    token::Token token(variant, offset(source), length, source.line, source.column);
+    advance(source, length);
     return Result<token::Token, Error>(token);
 }
 
@@ -243,7 +226,6 @@ void lexer::advance_until_new_line(Source& source) {
 }
 
 Result<token::Token, Error> lexer::get_string(Source& source) {
-    std::string literal = "";
     size_t line = source.line;
     size_t column = source.column;
     bool isRight = false;
@@ -260,29 +242,20 @@ Result<token::Token, Error> lexer::get_string(Source& source) {
     }
 
     advance(source);
+    size_t start = offset(source);
     while (!(at_end(source) || match(source, "\n"))) {
-        if (match(source, "\\n")) {
-            literal += "\n";
-            advance(source);
-        }
-        else if (match(source, "\\\"")) {
-            literal += "\"";
+        if (match(source, "\\n") || match(source, "\\\"") || match(source, "\\{")) {
             advance(source);
         }
         else if (match(source, "\"")) {
             break;
         }
-        else if (match(source, "\\{")) {
-            literal += "{";
-        }
         else if (match(source, "{")) {
             break;
         }
-        else {
-            literal += current(source);
-        }
         advance(source);
     }
+    size_t length = offset(source) - start;
 
     if (at_end(source) || match(source, "\n")) {
         return Result<token::Token, Error>(std::string("Error: Unclosed string\n"));
@@ -292,20 +265,20 @@ Result<token::Token, Error> lexer::get_string(Source& source) {
             source.onString.push(OnString{current(source), true});
             advance(source);
             if (isRight) {
-                return Result<token::Token, Error>(token::Token(token::StringMiddle, literal, line, column));
+                return Result<token::Token, Error>(token::Token(token::StringMiddle, start, length, line, column));
             }
             else {
-                return Result<token::Token, Error>(token::Token(token::StringLeft, literal, line, column));
+                return Result<token::Token, Error>(token::Token(token::StringLeft, start, length, line, column));
             }
         }
         else if (match(source, "\"")) {
             source.onString.pop();
             advance(source);
             if (isRight) {
-                return Result<token::Token, Error>(token::Token(token::StringRight, literal, line, column));
+                return Result<token::Token, Error>(token::Token(token::StringRight, start, length, line, column));
             }
             else {
-                return Result<token::Token, Error>(token::Token(token::String, literal, line, column));
+                return Result<token::Token, Error>(token::Token(token::String, start, length, line, column));
             }
         }
         else {
@@ -315,74 +288,73 @@ Result<token::Token, Error> lexer::get_string(Source& source) {
 }
 
 Result<token::Token, Error> lexer::get_identifier(Source& source) {
-    std::string literal = "";
+    size_t start = offset(source);
     size_t line = source.line;
     size_t column = source.column;
 
     while (!(at_end(source) || match(source, "\n"))) {
         if (!(isalnum(current(source)) || current(source) == '_')) break;
-        literal += current(source);
         advance(source);
     }
 
-    if (literal == "if")        return token::Token(token::If, "if", line, column);
-    if (literal == "else")      return token::Token(token::Else, "else", line, column);
-    if (literal == "while")     return token::Token(token::While, "while", line, column);
-    if (literal == "function")  return token::Token(token::Function, "function", line, column);
-    if (literal == "interface") return token::Token(token::Interface, "interface", line, column);
-    if (literal == "builtin")   return token::Token(token::Builtin, "builtin", line, column);
-    if (literal == "type")      return token::Token(token::Type, "type", line, column);
-    if (literal == "case")      return token::Token(token::Case, "case", line, column);
-    if (literal == "be")        return token::Token(token::Be, "be", line, column);
-    if (literal == "true")      return token::Token(token::True, "true", line, column);
-    if (literal == "false")     return token::Token(token::False, "false", line, column);
-    if (literal == "and")       return token::Token(token::And, "and", line, column);
-    if (literal == "or")        return token::Token(token::Or, "or", line, column);
-    if (literal == "use")       return token::Token(token::Use, "use", line, column);
-    if (literal == "include")   return token::Token(token::Include, "include", line, column);
-    if (literal == "break")     return token::Token(token::Break, "break", line, column);
-    if (literal == "continue")  return token::Token(token::Continue, "continue", line, column);
-    if (literal == "return")    return token::Token(token::Return, "return", line, column);
-    if (literal == "mut")       return token::Token(token::Mut, "mut", line, column);
-    if (literal == "new")       return token::Token(token::New, "new", line, column);
-    if (literal == "not")       return token::Token(token::Not, "not", line, column);
-    if (literal == "extern")    return token::Token(token::Extern, "extern", line, column);
-    if (literal == "link_with") return token::Token(token::LinkWith, "link_with", line, column);
-
-    return token::Token(token::Identifier, literal, line, column);
+    size_t length = offset(source) - start;
+    std::string_view literal(source.begin + start, length);
+
+    if (literal == "if")        return token::Token(token::If, start, length, line, column);
+    if (literal == "else")      return token::Token(token::Else, start, length, line, column);
+    if (literal == "while")     return token::Token(token::While, start, length, line, column);
+    if (literal == "function")  return token::Token(token::Function, start, length, line, column);
+    if (literal == "interface") return token::Token(token::Interface, start, length, line, column);
+    if (literal == "builtin")   return token::Token(token::Builtin, start, length, line, column);
+    if (literal == "type")      return token::Token(token::Type, start, length, line, column);
+    if (literal == "case")      return token::Token(token::Case, start, length, line, column);
+    if (literal == "be")        return token::Token(token::Be, start, length, line, column);
+    if (literal == "true")      return token::Token(token::True, start, length, line, column);
+    if (literal == "false")     return token::Token(token::False, start, length, line, column);
+    if (literal == "and")       return token::Token(token::And, start, length, line, column);
+    if (literal == "or")        return token::Token(token::Or, start, length, line, column);
+    if (literal == "use")       return token::Token(token::Use, start, length, line, column);
+    if (literal == "include")   return token::Token(token::Include, start, length, line, column);
+    if (literal == "break")     return token::Token(token::Break, start, length, line, column);
+    if (literal == "continue")  return token::Token(token::Continue, start, length, line, column);
+    if (literal == "return")    return token::Token(token::Return, start, length, line, column);
+    if (literal == "mut")       return token::Token(token::Mut, start, length, line, column);
+    if (literal == "new")       return token::Token(token::New, start, length, line, column);
+    if (literal == "not")       return token::Token(token::Not, start, length, line, column);
+    if (literal == "extern")    return token::Token(token::Extern, start, length, line, column);
+    if (literal == "link_with") return token::Token(token::LinkWith, start, length, line, column);
+
+    return token::Token(token::Identifier, start, length, line, column);
 }
 
 Result<token::Token, Error> lexer::get_number(Source& source) {
-    std::string literal = "";
+    size_t start = offset(source);
     size_t line = source.line;
     size_t column = source.column;
 
     // eg: .8
     if (match(source, ".")) {
         advance(source);
-        literal += "." + get_integer(source);
-        return token::Token(token::Float, literal, line, column);
+        get_integer(source);
+        return token::Token(token::Float, start, offset(source) - start, line, column);
     }
 
-    literal += get_integer(source);
+    get_integer(source);
 
     // eg: 6.7
     if (match(source, ".")) {
         advance(source);
-        literal += "." + get_integer(source);
-        return token::Token(token::Float, literal, line, column);
+        get_integer(source);
+        return token::Token(token::Float, start, offset(source) - start, line, column);
 
     // eg: 16
     } else {
-        return token::Token(token::Integer, literal, line, column);
+        return token::Token(token::Integer, start, offset(source) - start, line, column);
     }
 }
 
-std::string lexer::get_integer(Source& source) {
-    std::string integer = "";
+void lexer::get_integer(Source& source) {
     while (!(at_end(source) || match(source, "\n")) && isdigit(current(source))) {
-        integer += current(source);
         advance(source);
     }
-    return integer;
-}
\ No newline at end of file
+}
@@ -6,5 +6,6 @@
 #include "tokens.hpp"
 
 namespace lexer {
-    Result<std::vector<token::Token>, Errors> lex(std::filesystem::path path);
+    Result<token::Tokens, Errors> lex(std::filesystem::path path);
+    Result<token::Tokens, Errors> lex(std::string buffer, std::filesystem::path path = "");
 };
\ No newline at end of file
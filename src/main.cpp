@@ -1,5 +1,8 @@
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <optional>
+#include <random>
 
 #include "errors.hpp"
 #include "lexer.hpp"
@@ -7,6 +10,11 @@
 #include "parser.hpp"
 #include "semantic.hpp"
 #include "codegen.hpp"
+#include "diamond.hpp"
+#include "codegen/executable_cache.hpp"
+#include "server.hpp"
+#include "batch.hpp"
+#include "trace.hpp"
 
 // Definitions and prototypes
 // --------------------------
@@ -21,6 +29,22 @@ void enable_colored_text_and_unicode() {
     // Unicode
     SetConsoleOutputCP(65001);
 }
+
+void run_executable(std::filesystem::path executable) {
+    trace::finish();
+    system(("\"" + executable.string() + "\"").c_str());
+}
+#else
+#include <unistd.h>
+
+// Replaces the compiler process with the program
+void run_executable(std::filesystem::path executable) {
+    trace::finish();
+    std::cout.flush();
+    fflush(stdout);
+    execl(executable.c_str(), executable.c_str(), (char*) nullptr);
+    system(("\"" + executable.string() + "\"").c_str());
+}
 #endif
 
 enum CommandType {
@@ -31,8 +55,11 @@ enum CommandType {
 
 struct Command {
     std::filesystem::path file;
+    std::vector<std::filesystem::path> files;
     CommandType type;
     std::vector<std::string> options;
+    codegen::Options codegen_options;
+    std::optional<std::filesystem::path> time_trace; // Empty to use the default path
 
     Command(std::string file, CommandType type) : file(file), type(type) {}
     Command(std::string file, CommandType type, std::vector<std::string> options) : file(file), type(type), options(options) {}
@@ -44,29 +71,88 @@ void print_usage_and_exit() {
     exit(EXIT_FAILURE);
 }
 
+bool is_emit_option(std::string option) {
+    return option == "--llvm-ir" || option == "--ast" || option == "--ast-with-types" || option == "--ast-with-concrete-types" || option == "--tokens" || option == "--object-code" || option == "--assembly" || option == "--target";
+}
+
 void check_usage(int argc, char *argv[]) {
     if (argc < 3) {
         print_usage_and_exit();
     }
-    if (argv[1] == std::string("run") && argc < 3) {
-        print_usage_and_exit();
-    }
-    if (argv[1] == std::string("emit") && (argc < 4 || !(argv[2] == std::string("--llvm-ir") || argv[2] == std::string("--ast") || argv[2] == std::string("--ast-with-types") || argv[2] == std::string("--ast-with-concrete-types") || argv[2] == std::string("--tokens") || argv[2] == std::string("--object-code") || argv[2] == std::string("--assembly")))) {
+    if (!(argv[1] == std::string("build") || argv[1] == std::string("run") || argv[1] == std::string("emit"))) {
         print_usage_and_exit();
     }
 };
 
 Command get_command(int argc, char *argv[]) {
-    if (argv[1] == std::string("build")) {
-        return Command(std::string(argv[2]), BuildCommand);
+    std::vector<std::filesystem::path> files;
+    std::vector<std::string> options;
+    codegen::Options codegen_options;
+    std::optional<std::filesystem::path> time_trace;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--jobs") {
+            if (i + 1 == argc) print_usage_and_exit();
+            char* end;
+            long jobs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || jobs < 1) print_usage_and_exit();
+            codegen_options.jobs = (size_t) jobs;
+        }
+        else if (arg.rfind("--target-cpu=", 0) == 0) {
+            codegen_options.target_cpu = arg.substr(std::string("--target-cpu=").size());
+            if (codegen_options.target_cpu.empty()) print_usage_and_exit();
+        }
+        else if (arg.rfind("--target-features=", 0) == 0) {
+            codegen_options.target_features = arg.substr(std::string("--target-features=").size());
+        }
+        else if (arg == "--time-trace") {
+            time_trace = "";
+        }
+        else if (arg.rfind("--time-trace=", 0) == 0) {
+            time_trace = arg.substr(std::string("--time-trace=").size());
+            if (time_trace.value().empty()) print_usage_and_exit();
+        }
+        else if (arg == "-O0") codegen_options.optimization_level = codegen::O0;
+        else if (arg == "-O1") codegen_options.optimization_level = codegen::O1;
+        else if (arg == "-O2") codegen_options.optimization_level = codegen::O2;
+        else if (arg == "-O3") codegen_options.optimization_level = codegen::O3;
+        else if (arg == "-Os") codegen_options.optimization_level = codegen::Os;
+        else if (arg.size() > 2 && arg.substr(0, 2) == "--") {
+            options.push_back(arg);
+        }
+        else {
+            files.push_back(arg);
+        }
     }
-    if (argv[1] == std::string("run")) {
-        return Command(std::string(argv[2]), RunCommand);
+
+    if (files.size() == 0) print_usage_and_exit();
+
+    Command command(files[0].string(), BuildCommand, options);
+    command.files = files;
+    if      (argv[1] == std::string("build")) command.type = BuildCommand;
+    else if (argv[1] == std::string("run"))   command.type = RunCommand;
+    else if (argv[1] == std::string("emit"))  command.type = EmitCommand;
+    command.codegen_options = codegen_options;
+    command.time_trace = time_trace;
+
+    // Emit takes exactly one option saying what to emit, run can be asked
+    // to use the jit
+    if (command.type == EmitCommand) {
+        if (options.size() != 1 || !is_emit_option(options[0])) print_usage_and_exit();
+    }
+    else if (command.type == RunCommand) {
+        if (options.size() > 1 || (options.size() == 1 && options[0] != "--jit")) print_usage_and_exit();
     }
-    if (argv[1] == std::string("emit")) {
-        return Command(std::string(argv[3]), EmitCommand, std::vector<std::string>{argv[2]});
+    else {
+        if (options.size() > 1 || (options.size() == 1 && options[0] != "--batch")) print_usage_and_exit();
     }
-    assert(false);
+
+    // Only batch builds take more than one file
+    bool is_batch = options.size() == 1 && options[0] == "--batch";
+    if (files.size() > 1 && !is_batch) print_usage_and_exit();
+
+    return command;
 }
 
 void print_errors_and_exit(std::vector<Error> errors) {
@@ -77,28 +163,19 @@ void print_errors_and_exit(std::vector<Error> errors) {
 }
 
 void build(Command command) {
-    // Get program name
-    std::string program_name = utilities::get_program_name(command.file);
-
-    // Lex
-    auto lexing_result = lexer::lex(std::filesystem::path(command.file));
-    if (lexing_result.is_error()) print_errors_and_exit(lexing_result.get_error());
-    auto tokens = lexing_result.get_value();
-
-    // Parse
-    auto parsing_result = parse::program(tokens, command.file);
-    if (parsing_result.is_error()) print_errors_and_exit(parsing_result.get_error());
-    auto ast = parsing_result.get_value();
-
-    // Analyze
-    auto analyze_result = semantic::analyze(ast);
-    if (analyze_result.is_error()) print_errors_and_exit(analyze_result.get_error());
+    if (command.options.size() == 1 && command.options[0] == "--batch") {
+        exit(batch::build(command.files, command.codegen_options));
+    }
 
-    // Generate executable
-    codegen::generate_executable(ast, program_name);
+    diamond::Compilation compilation(command.file, command.codegen_options);
+    compilation.program_name = utilities::get_program_name(command.file);
 
-    // Cleanup
-    ast.free();
+    if (!compilation.build()) {
+        for (auto& diagnostic: compilation.diagnostics) {
+            std::cout << diagnostic << "\n";
+        }
+        exit(EXIT_FAILURE);
+    }
 }
 
 void run(Command command) {
@@ -118,12 +195,65 @@ void run(Command command) {
     if (parsing_result.is_error()) print_errors_and_exit(parsing_result.get_error());
     auto ast = parsing_result.get_value();
 
+    // Look for an executable already built from the same sources
+    bool jit = command.options.size() > 0 && command.options[0] == "--jit";
+    std::optional<std::filesystem::path> cached_executable;
+    if (!jit) {
+        semantic::parse_modules(ast);
+        cached_executable = codegen::get_cached_executable_path(ast, command.codegen_options);
+        if (cached_executable.has_value()
+        &&  utilities::file_exists(utilities::get_executable_name(cached_executable.value().string()))) {
+            ast.free();
+            utilities::mark_as_used(utilities::get_executable_name(cached_executable.value().string()));
+            run_executable(utilities::get_executable_name(cached_executable.value().string()));
+            return;
+        }
+    }
+
     // Analyze
     auto analyze_result = semantic::analyze(ast);
     if (analyze_result.is_error()) print_errors_and_exit(analyze_result.get_error());
 
+    // Run in this process, programs that link with other libraries still
+    // need the linker
+    if (jit && ast.link_with.size() == 0) {
+        bool result = codegen::run_with_jit(ast, program_name, command.codegen_options);
+        ast.free();
+        if (!result) exit(EXIT_FAILURE);
+        return;
+    }
+
+    // Build into the cache, under a temporary name so other compilers
+    // running the same program never see a partial executable
+    if (cached_executable.has_value()) {
+        std::error_code error;
+        std::filesystem::create_directories(cached_executable.value().parent_path(), error);
+        if (error) cached_executable = std::nullopt;
+    }
+
+    if (cached_executable.has_value()) {
+        std::error_code error;
+        std::string temporary = cached_executable.value().string() + "-" + std::to_string(std::random_device{}());
+        auto result = codegen::generate_executable(ast, temporary, command.codegen_options);
+        ast.free();
+        if (result.is_error()) print_errors_and_exit({result.get_error()});
+
+        std::filesystem::path executable = utilities::get_executable_name(cached_executable.value().string());
+        std::filesystem::rename(utilities::get_executable_name(temporary), executable, error);
+        if (error) {
+            system(("\"" + utilities::get_executable_name(temporary) + "\"").c_str());
+            remove(utilities::get_executable_name(temporary).c_str());
+            return;
+        }
+
+        codegen::trim_executable_cache();
+        run_executable(executable);
+        return;
+    }
+
     // Generate executable
-    codegen::generate_executable(ast, program_name);
+    auto result = codegen::generate_executable(ast, program_name, command.codegen_options);
+    if (result.is_error()) print_errors_and_exit({result.get_error()});
 
     // Run executable
     system(utilities::get_run_command(program_name).c_str());
@@ -137,6 +267,13 @@ void run(Command command) {
 }
 
 void emit(Command command) {
+    // Emit target
+    if (command.options[0] == std::string("--target")) {
+        auto target = codegen::get_target(command.codegen_options);
+        std::cout << target.triple << "\n" << target.cpu << "\n" << target.features << "\n";
+        return;
+    }
+
     // Get program name
     std::string program_name = utilities::get_program_name(command.file);
 
@@ -183,21 +320,21 @@ void emit(Command command) {
 
     // Emit LLVM-IR
     if (command.options[0] == std::string("--llvm-ir")) {
-        codegen::print_llvm_ir(ast, program_name);
+        codegen::print_llvm_ir(ast, program_name, command.codegen_options);
         ast.free();
         return;
     }
 
     // Emit asm
     if (command.options[0] == std::string("--assembly")) {
-        codegen::print_assembly(ast, program_name);
+        codegen::print_assembly(ast, program_name, command.codegen_options);
         ast.free();
         return;
     }
 
     // Emit object code
     if (command.options[0] == std::string("--object-code")) {
-        codegen::generate_object_code(ast, program_name);
+        codegen::generate_object_code(ast, program_name, command.codegen_options);
         ast.free();
         return;
     }
@@ -205,17 +342,20 @@ void emit(Command command) {
 
 // Main
 // ----
-int main(int argc, char *argv[]) {
-    #ifdef _WIN32
-        enable_colored_text_and_unicode();
-    #endif
-
+int execute(int argc, char *argv[]) {
     // Check usage
     check_usage(argc, argv);
 
     // Get command line arguments
     Command command = get_command(argc, argv);
 
+    // Start tracing, the trace is written when the compiler exits
+    if (command.time_trace.has_value()) {
+        auto path = command.time_trace.value();
+        if (path.empty()) path = utilities::get_program_name(command.file) + ".trace.json";
+        trace::start(path);
+    }
+
     // Execute command
     if (command.type == BuildCommand) {
         build(command);
@@ -229,3 +369,22 @@ int main(int argc, char *argv[]) {
 
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    #ifdef _WIN32
+        enable_colored_text_and_unicode();
+    #endif
+
+    // Start server
+    if (argc >= 2 && argv[1] == std::string("server")) {
+        const char* socket_path = argc == 3 ? argv[2] : getenv("DIAMOND_SERVER");
+        if (argc > 3 || !socket_path || socket_path[0] == '\0') print_usage_and_exit();
+        server::serve(socket_path, execute);
+    }
+
+    // Let the server do it if there is one
+    auto status = server::forward(argc, argv);
+    if (status.has_value()) return status.value();
+
+    return execute(argc, argv);
+}
@@ -3,23 +3,25 @@
 #include <cstdlib>
 #include <iostream>
 #include <cstring>
+#include <initializer_list>
 
 #include "errors.hpp"
 #include "parser.hpp"
 #include "ast.hpp"
 #include  "utilities.hpp"
+#include "trace.hpp"
 
 // Prototypes and definitions
 // --------------------------
 struct Parser {
-    const std::vector<token::Token>& tokens;
+    const token::Tokens& tokens;
     size_t position = 0;
     const std::filesystem::path& file;
     ast::Ast& ast;
     std::vector<size_t> indentation_level;
     Errors errors;
 
-    Parser(ast::Ast& ast, const std::vector<token::Token>& tokens, const std::filesystem::path& file) : ast(ast), tokens(tokens), file(file) {}
+    Parser(ast::Ast& ast, const token::Tokens& tokens, const std::filesystem::path& file) : ast(ast), tokens(tokens), file(file) {}
 
     Result<ast::Node*, Error> parse_program();
     Result<ast::Node*, Error> parse_block();
@@ -75,16 +77,16 @@ struct Parser {
     Result<ast::Node*, Error> parse_index_access(ast::Node* expression);
     Result<token::Token, Error> parse_token(token::TokenVariant token);
 
-    token::Token current();
+    const token::Token& current();
     size_t current_indentation();
     void advance();
     void advance_until_next_statement();
     bool at_end();
-    bool match(std::vector<token::TokenVariant> tokens);
+    bool match(std::initializer_list<token::TokenVariant> tokens);
     Location location();
 };
 
-token::Token Parser::current() {
+const token::Token& Parser::current() {
     assert(this->position < this->tokens.size());
     return this->tokens[this->position];
 }
@@ -110,11 +112,13 @@ bool Parser::at_end() {
     return this->current() == token::EndOfFile;
 }
 
-bool Parser::match(std::vector<token::TokenVariant> tokens) {
-    for (size_t i = 0; i < tokens.size(); i++) {
-        if (this->position + i >= this->tokens.size() || this->tokens[this->position + i] != tokens[i]) {
+bool Parser::match(std::initializer_list<token::TokenVariant> tokens) {
+    size_t i = 0;
+    for (auto token: tokens) {
+        if (this->position + i >= this->tokens.size() || this->tokens[this->position + i] != token) {
             return false;
         }
+        i++;
     }
     return true;
 }
@@ -125,9 +129,12 @@ Location Parser::location() {
 
 // Parsing
 // -------
-Result<ast::Ast, Errors> parse::program(const std::vector<token::Token>& tokens, const std::filesystem::path& file) {
+Result<ast::Ast, Errors> parse::program(const token::Tokens& tokens, const std::filesystem::path& file) {
+    trace::Span span("Parse", [&] {return file.string();});
     ast::Ast ast;
-    std::filesystem::path module_path = std::filesystem::canonical(std::filesystem::current_path() / file);
+    std::error_code error;
+    std::filesystem::path module_path = std::filesystem::canonical(std::filesystem::current_path() / file, error);
+    if (error) return Errors{errors::file_couldnt_be_found(file)};
 
     Parser parser(ast, tokens, module_path);
     auto parsing_result = parser.parse_program();
@@ -140,7 +147,8 @@ Result<ast::Ast, Errors> parse::program(const std::vector<token::Token>& tokens,
     return ast;
 }
 
-Result<Ok, Errors> parse::module(ast::Ast& ast, const std::vector<token::Token>& tokens, const std::filesystem::path& file) {
+Result<Ok, Errors> parse::module(ast::Ast& ast, const token::Tokens& tokens, const std::filesystem::path& file) {
+    trace::Span span("Parse", [&] {return file.string();});
     Parser parser(ast, tokens, file);
     auto parsing_result = parser.parse_block();
     if (parsing_result.is_error()) return parser.errors;
@@ -592,7 +600,7 @@ Result<ast::Node*, Error> Parser::parse_function() {
         function.identifier->value = "[]:mut";
     }
 
-    this->ast.push_back(function);
+    this->ast.push_back(std::move(function));
     return this->ast.last_element();
 }
 
@@ -756,7 +764,7 @@ Result<ast::Node*, Error> Parser::parse_builtin() {
         builtin.identifier->value = "[]:mut";
     }
 
-    this->ast.push_back(builtin);
+    this->ast.push_back(std::move(builtin));
     return this->ast.last_element();
 }
 
@@ -833,7 +841,7 @@ Result<ast::Node*, Error> Parser::parse_extern() {
 
     function.return_type = type.get_value();
 
-    this->ast.push_back(function);
+    this->ast.push_back(std::move(function));
     return this->ast.last_element();
 }
 
@@ -956,7 +964,7 @@ Result<Ok, Error> Parser::parse_type_definition_body(ast::TypeNode* node) {
 Result<ast::Type, Error> Parser::parse_type() {
     auto type_identifier = this->parse_token(token::Identifier);
     if (type_identifier.is_error()) return Error {};
-    std::string literal = type_identifier.get_value().get_literal();
+    std::string literal = this->tokens.get_literal(type_identifier.get_value());
     ast::Type type = ast::Type(literal);
 
     // If is type variable
@@ -989,10 +997,10 @@ Result<ast::Type, Error> Parser::parse_type() {
 
 Result<ast::InterfaceType, Error> Parser::parse_interface_type() {
     auto type_identifier = this->parse_token(token::Identifier);
-    if (type_identifier.is_ok()) return ast::InterfaceType(type_identifier.get_value().get_literal());
+    if (type_identifier.is_ok()) return ast::InterfaceType(this->tokens.get_literal(type_identifier.get_value()));
 
     type_identifier = this->parse_token(token::Type);
-    if (type_identifier.is_ok()) return ast::InterfaceType(type_identifier.get_value().get_literal());
+    if (type_identifier.is_ok()) return ast::InterfaceType(this->tokens.get_literal(type_identifier.get_value()));
 
     return Error {};
 }
@@ -1542,19 +1550,20 @@ Result<ast::Node*, Error> Parser::parse_not_expr() {
 // term → factor (("+"|"-") factor)*
 // factor → primary (("*"|"/"|"%") primary)*
 Result<ast::Node*, Error> Parser::parse_binary(int precedence) {
-    static std::map<token::TokenVariant, int> operators;
-    operators[token::Or] = 1;
-    operators[token::And] = 2;
-    operators[token::EqualEqual] = 3;
-    operators[token::Less] = 4;
-    operators[token::LessEqual] = 4;
-    operators[token::Greater] = 4;
-    operators[token::GreaterEqual] = 4;
-    operators[token::Plus] = 5;
-    operators[token::Minus] = 5;
-    operators[token::Star] = 6;
-    operators[token::Slash] = 6;
-    operators[token::Modulo] = 6;
+    static const std::map<token::TokenVariant, int> operators = {
+        {token::Or, 1},
+        {token::And, 2},
+        {token::EqualEqual, 3},
+        {token::Less, 4},
+        {token::LessEqual, 4},
+        {token::Greater, 4},
+        {token::GreaterEqual, 4},
+        {token::Plus, 5},
+        {token::Minus, 5},
+        {token::Star, 6},
+        {token::Slash, 6},
+        {token::Modulo, 6}
+    };
 
     if (precedence > std::max_element(operators.begin(), operators.end(), [] (auto a, auto b) { return a.second < b.second;})->second) {
         return this->parse_primary();
@@ -1572,7 +1581,7 @@ Result<ast::Node*, Error> Parser::parse_binary(int precedence) {
 
             // Parse operator
             auto op = this->current().variant;
-            if (operators.find(op) == operators.end() || operators[op] != precedence) break;
+            if (operators.find(op) == operators.end() || operators.at(op) != precedence) break;
 
             auto identifier = this->parse_identifier(op);
             if (identifier.is_error()) return identifier;
@@ -1774,7 +1783,7 @@ Result<ast::Node*, Error> Parser::parse_float() {
 
     // Parse float
     if (this->current() != token::Float) assert(false);
-    float_node.value = atof(this->current().get_literal().c_str());
+    float_node.value = atof(this->tokens.get_literal(this->current()).c_str());
 
     this->advance();
     this->ast.push_back(float_node);
@@ -1789,7 +1798,7 @@ Result<ast::Node*, Error> Parser::parse_integer() {
     // Parse integer
     if (this->current() != token::Integer) assert(false);
     char* ptr;
-    integer.value = strtol(this->current().get_literal().c_str(), &ptr, 10);
+    integer.value = strtol(this->tokens.get_literal(this->current()).c_str(), &ptr, 10);
 
     this->advance();
     this->ast.push_back(integer);
@@ -1870,7 +1879,7 @@ Result<ast::Node*, Error> Parser::parse_identifier(token::TokenVariant token) {
     // Parse identifier
     auto result = this->parse_token(token);
     if (result.is_error()) return Error {};
-    identifier.value = result.get_value().get_literal();
+    identifier.value = symbol::Symbol(this->tokens.get_text(result.get_value()));
 
     this->ast.push_back(identifier);
     return this->ast.last_element();
@@ -1884,7 +1893,7 @@ Result<ast::Node*, Error> Parser::parse_string() {
     // Parse string
     auto result = this->parse_token(token::String);
     if (result.is_error()) return Error {};
-    string.value = result.get_value().get_literal();
+    string.value = this->tokens.get_literal(result.get_value());
 
     this->ast.push_back(string);
     return this->ast.last_element();
@@ -1898,7 +1907,7 @@ Result<ast::Node*, Error> Parser::parse_interpolated_string() {
     // Parse string
     auto result = this->parse_token(token::StringLeft);
     if (result.is_error()) return Error {};
-    string.strings.push_back(result.get_value().get_literal());
+    string.strings.push_back(this->tokens.get_literal(result.get_value()));
 
     while (true) {
         // Parse expression
@@ -1909,7 +1918,7 @@ Result<ast::Node*, Error> Parser::parse_interpolated_string() {
         if (this->current() == token::StringMiddle) {
             auto result = this->parse_token(token::StringMiddle);
             if (result.is_error()) return Error {};
-            string.strings.push_back(result.get_value().get_literal());
+            string.strings.push_back(this->tokens.get_literal(result.get_value()));
         }
         else {
             break;
@@ -1919,7 +1928,7 @@ Result<ast::Node*, Error> Parser::parse_interpolated_string() {
     // Parse string
     result = this->parse_token(token::StringRight);
     if (result.is_error()) return Error {};
-    string.strings.push_back(result.get_value().get_literal());
+    string.strings.push_back(this->tokens.get_literal(result.get_value()));
 
     this->ast.push_back(string);
     return this->ast.last_element();
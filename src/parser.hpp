@@ -7,8 +7,8 @@
 #include "ast.hpp"
 
 namespace parse {
-    Result<ast::Ast, Errors> program(const std::vector<token::Token>& tokens, const std::filesystem::path& file);
-    Result<Ok, Errors> module(ast::Ast& ast, const std::vector<token::Token>& tokens, const std::filesystem::path& file);
+    Result<ast::Ast, Errors> program(const token::Tokens& tokens, const std::filesystem::path& file);
+    Result<Ok, Errors> module(ast::Ast& ast, const token::Tokens& tokens, const std::filesystem::path& file);
 };
 
 #endif
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "call_graph.hpp"
+
+// Calls
+// -----
+// Calls are collected by name, so a call to an overloaded function depends
+// on all its overloads.
+static void collect_calls(ast::Node* node, std::vector<symbol::Symbol>& calls) {
+    if (node == nullptr) return;
+
+    switch (node->index()) {
+        case ast::Block: {
+            auto& block = std::get<ast::BlockNode>(*node);
+            for (auto statement: block.statements) collect_calls(statement, calls);
+            for (auto function: block.functions) collect_calls(function->body, calls);
+            break;
+        }
+        case ast::Declaration: collect_calls(std::get<ast::DeclarationNode>(*node).expression, calls); break;
+        case ast::Assignment: {
+            collect_calls(std::get<ast::AssignmentNode>(*node).assignable, calls);
+            collect_calls(std::get<ast::AssignmentNode>(*node).expression, calls);
+            break;
+        }
+        case ast::Return: {
+            auto& expression = std::get<ast::ReturnNode>(*node).expression;
+            if (expression.has_value()) collect_calls(expression.value(), calls);
+            break;
+        }
+        case ast::IfElse: {
+            auto& if_else = std::get<ast::IfElseNode>(*node);
+            collect_calls(if_else.condition, calls);
+            collect_calls(if_else.if_branch, calls);
+            if (if_else.else_branch.has_value()) collect_calls(if_else.else_branch.value(), calls);
+            break;
+        }
+        case ast::While: {
+            collect_calls(std::get<ast::WhileNode>(*node).condition, calls);
+            collect_calls(std::get<ast::WhileNode>(*node).block, calls);
+            break;
+        }
+        case ast::CallArgument: collect_calls(std::get<ast::CallArgumentNode>(*node).expression, calls); break;
+        case ast::Call: {
+            auto& call = std::get<ast::CallNode>(*node);
+            calls.push_back(call.identifier->value);
+            for (auto arg: call.args) collect_calls(arg->expression, calls);
+            break;
+        }
+        case ast::StructLiteral: {
+            for (auto& field: std::get<ast::StructLiteralNode>(*node).fields) collect_calls(field.second, calls);
+            break;
+        }
+        case ast::InterpolatedString: {
+            for (auto expression: std::get<ast::InterpolatedStringNode>(*node).expressions) collect_calls(expression, calls);
+            break;
+        }
+        case ast::Array: {
+            for (auto element: std::get<ast::ArrayNode>(*node).elements) collect_calls(element, calls);
+            break;
+        }
+        case ast::FieldAccess: collect_calls(std::get<ast::FieldAccessNode>(*node).accessed, calls); break;
+        case ast::AddressOf: collect_calls(std::get<ast::AddressOfNode>(*node).expression, calls); break;
+        case ast::Dereference: collect_calls(std::get<ast::DereferenceNode>(*node).expression, calls); break;
+        case ast::New: collect_calls(std::get<ast::NewNode>(*node).expression, calls); break;
+        default: break;
+    }
+}
+
+// Strongly connected components
+// -----------------------------
+// Tarjan's algorithm, it finds a component only after all the components
+// reachable from it, so components come out with callees first. It keeps
+// its own stack of calls being visited, long call chains would overflow
+// the native stack otherwise.
+struct CallGraph {
+    struct Frame {
+        size_t function;
+        size_t next_edge;
+    };
+
+    std::vector<std::vector<size_t>> edges;
+    std::vector<size_t> index;
+    std::vector<size_t> low_link;
+    std::vector<bool> on_stack;
+    std::vector<size_t> stack;
+    std::vector<Frame> frames;
+    size_t next_index = 1;
+    std::vector<size_t> order;
+
+    void start(size_t function) {
+        this->index[function] = this->next_index;
+        this->low_link[function] = this->next_index;
+        this->next_index++;
+        this->stack.push_back(function);
+        this->on_stack[function] = true;
+        this->frames.push_back(Frame {function, 0});
+    }
+
+    void visit(size_t root) {
+        this->start(root);
+        while (this->frames.size() > 0) {
+            auto& frame = this->frames.back();
+            size_t function = frame.function;
+
+            // Visit next callee
+            if (frame.next_edge < this->edges[function].size()) {
+                size_t callee = this->edges[function][frame.next_edge++];
+                if (this->index[callee] == 0) {
+                    this->start(callee);
+                }
+                else if (this->on_stack[callee]) {
+                    this->low_link[function] = std::min(this->low_link[function], this->index[callee]);
+                }
+                continue;
+            }
+
+            // Pop component if function is its root
+            if (this->low_link[function] == this->index[function]) {
+                size_t start = this->order.size();
+                size_t member;
+                do {
+                    member = this->stack.back();
+                    this->stack.pop_back();
+                    this->on_stack[member] = false;
+                    this->order.push_back(member);
+                } while (member != function);
+                std::sort(this->order.begin() + start, this->order.end());
+            }
+
+            // Return to caller
+            this->frames.pop_back();
+            if (this->frames.size() > 0) {
+                size_t caller = this->frames.back().function;
+                this->low_link[caller] = std::min(this->low_link[caller], this->low_link[function]);
+            }
+        }
+    }
+};
+
+// Returns the positions of the functions each function calls
+static std::vector<std::vector<size_t>> get_calls(const std::vector<ast::FunctionNode*>& functions) {
+    std::unordered_map<symbol::Symbol, std::vector<size_t>> functions_by_name;
+    for (size_t i = 0; i < functions.size(); i++) {
+        functions_by_name[functions[i]->identifier->value].push_back(i);
+    }
+
+    std::vector<std::vector<size_t>> edges(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        std::vector<symbol::Symbol> calls;
+        collect_calls(functions[i]->body, calls);
+        for (auto& call: calls) {
+            auto it = functions_by_name.find(call);
+            if (it == functions_by_name.end()) continue;
+            edges[i].insert(edges[i].end(), it->second.begin(), it->second.end());
+        }
+    }
+    return edges;
+}
+
+std::vector<ast::FunctionNode*> semantic::order_by_calls(const std::vector<ast::FunctionNode*>& functions) {
+    // Build call graph
+    CallGraph graph;
+    graph.edges = get_calls(functions);
+
+    // Order functions
+    graph.index.assign(functions.size(), 0);
+    graph.low_link.assign(functions.size(), 0);
+    graph.on_stack.assign(functions.size(), false);
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (graph.index[i] == 0) graph.visit(i);
+    }
+
+    std::vector<ast::FunctionNode*> ordered;
+    for (size_t i: graph.order) {
+        ordered.push_back(functions[i]);
+    }
+    return ordered;
+}
+
+// Groups
+// ------
+std::vector<std::vector<ast::FunctionNode*>> semantic::group_by_calls(const std::vector<ast::FunctionNode*>& functions) {
+    auto edges = get_calls(functions);
+
+    UnionFind<size_t> union_find;
+    for (size_t i = 0; i < functions.size(); i++) {
+        union_find.insert(i);
+    }
+    for (size_t i = 0; i < functions.size(); i++) {
+        for (size_t callee: edges[i]) {
+            union_find.merge(i, callee);
+        }
+    }
+
+    std::vector<std::vector<ast::FunctionNode*>> groups;
+    for (auto& set: union_find.get_sets()) {
+        groups.push_back({});
+        for (size_t i: set.elements) {
+            groups.back().push_back(functions[i]);
+        }
+    }
+    return groups;
+}
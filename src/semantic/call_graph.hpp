@@ -0,0 +1,20 @@
+#ifndef SEMANTIC_CALL_GRAPH_HPP
+#define SEMANTIC_CALL_GRAPH_HPP
+
+#include <vector>
+
+#include "../ast.hpp"
+
+namespace semantic {
+    // Returns the functions ordered so the functions called come before the
+    // functions calling them. Functions that call each other (strongly connected
+    // components of the call graph) are kept in the order they were declared.
+    std::vector<ast::FunctionNode*> order_by_calls(const std::vector<ast::FunctionNode*>& functions);
+
+    // Splits the functions in groups, functions calling each other directly
+    // or through other functions end up in the same group. Groups are in the
+    // order of their first function and keep the order of the functions.
+    std::vector<std::vector<ast::FunctionNode*>> group_by_calls(const std::vector<ast::FunctionNode*>& functions);
+}
+
+#endif
@@ -114,26 +114,28 @@ semantic::Scope semantic::current_scope(Context& context) {
     assert(context.scopes.variables_scopes.size() != 0);
     return semantic::Scope{
         context.scopes.variables_scopes[context.scopes.variables_scopes.size() - 1],
-        context.scopes.functions_and_types_scopes.scopes[context.scopes.functions_and_types_scopes.scopes.size() - 1]
+        std::as_const(context.scopes.functions_and_types_scopes).current_scope()
     };
 }
 
-std::optional<semantic::Binding> semantic::get_binding(Context& context, std::string identifier) {
+std::optional<semantic::Binding> semantic::get_binding(Context& context, symbol::Symbol identifier) {
     for (auto scope = context.scopes.variables_scopes.rbegin(); scope != context.scopes.variables_scopes.rend(); scope++) {
-        if (scope->find(identifier) != scope->end()) {
-            return (*scope)[identifier];
+        auto it = scope->find(identifier);
+        if (it != scope->end()) {
+            return it->second;
         }
     }
     for (auto scope = context.scopes.functions_and_types_scopes.scopes.rbegin(); scope != context.scopes.functions_and_types_scopes.scopes.rend(); scope++) {
-        if (scope->find(identifier) != scope->end()) {
-            if ((*scope)[identifier]->index() == ast::Interface) {
-                return Binding((ast::InterfaceNode*) (*scope)[identifier]);
+        auto it = (*scope)->find(identifier);
+        if (it != (*scope)->end()) {
+            if (it->second->index() == ast::Interface) {
+                return Binding((ast::InterfaceNode*) it->second);
             }
-            else if ((*scope)[identifier]->index() == ast::Function) {
-                return Binding((ast::FunctionNode*) (*scope)[identifier]);
+            else if (it->second->index() == ast::Function) {
+                return Binding((ast::FunctionNode*) it->second);
             }
-            else if ((*scope)[identifier]->index() == ast::TypeDef) {
-                return Binding((ast::TypeNode*) (*scope)[identifier]);
+            else if (it->second->index() == ast::TypeDef) {
+                return Binding((ast::TypeNode*) it->second);
             }
         }
     }
@@ -141,6 +143,7 @@ std::optional<semantic::Binding> semantic::get_binding(Context& context, std::st
 }
 
 // Work with modules
+// Only the pointers to the definition scopes are copied, see FunctionsAndTypesScopes
 semantic::Scopes semantic::get_definitions(Context& context) {
     Scopes scopes;
     scopes.functions_and_types_scopes = context.scopes.functions_and_types_scopes;
@@ -177,29 +180,37 @@ void semantic::add_parameter_constraint(Context& context, ast::Type type, ast::T
 }
 
 // For unify and analyze
+void semantic::add_labeled_type_constraint(Context& context, ast::Type label, const Set<ast::Type>& types) {
+    auto& labeled = context.type_inference.labeled_type_constraints[label];
+    for (auto& type: types.elements) {
+        labeled.insert(type);
+        context.type_inference.labels[type] = label;
+    }
+}
+
 ast::Type semantic::get_unified_type(Context& context, ast::Type type_var) {
-    for (auto it = context.type_inference.labeled_type_constraints.begin(); it != context.type_inference.labeled_type_constraints.end(); it++) {
-        if (it->second.contains(type_var)) {
-            type_var = it->first;
+    auto label = context.type_inference.labels.find(type_var);
+    if (label != context.type_inference.labels.end()) {
+        type_var = label->second;
 
-            if (type_var.is_nominal_type()) {
-                for (size_t i = 0; i < type_var.as_nominal_type().parameters.size(); i++) {
-                    type_var.as_nominal_type().parameters[i] = semantic::get_unified_type(context, type_var.as_nominal_type().parameters[i]);
-                }
+        if (type_var.is_nominal_type()) {
+            for (size_t i = 0; i < type_var.as_nominal_type().parameters.size(); i++) {
+                type_var.as_nominal_type().parameters[i] = semantic::get_unified_type(context, type_var.as_nominal_type().parameters[i]);
             }
-            else if (type_var.is_struct_type()) {
-                for (auto field: type_var.as_struct_type().fields) {
-                    type_var.as_struct_type().fields[field.name] = semantic::get_unified_type(context, field.type);
-                } 
-            }
-
-            return type_var;
         }
+        else if (type_var.is_struct_type()) {
+            for (auto field: type_var.as_struct_type().fields) {
+                type_var.as_struct_type().fields[field.name] = semantic::get_unified_type(context, field.type);
+            } 
+        }
+
+        return type_var;
     }
 
     if (type_var.is_type_variable()) { 
         ast::Type new_type_var = semantic::new_final_type_variable(context);
         context.type_inference.labeled_type_constraints[new_type_var] = Set<ast::Type>({type_var});
+        context.type_inference.labels[type_var] = new_type_var;
         return new_type_var;
     }
     else if (type_var.is_nominal_type()) {
@@ -221,21 +232,18 @@ void semantic::set_unified_type(Context& context, ast::Type type_var, ast::Type
     auto it = context.type_inference.labeled_type_constraints.find(type_var);
 
     if (it == context.type_inference.labeled_type_constraints.end()) {
-        context.type_inference.labeled_type_constraints[new_type] = Set<ast::Type>();
-        context.type_inference.labeled_type_constraints[new_type].insert(type_var);
+        // Types that were labeled with new_type lose their label
+        for (auto& type: context.type_inference.labeled_type_constraints[new_type].elements) {
+            context.type_inference.labels.erase(type);
+        }
+
+        context.type_inference.labeled_type_constraints[new_type] = Set<ast::Type>({type_var});
+        context.type_inference.labels[type_var] = new_type;
     }
     else {
-        Set<ast::Type> set = context.type_inference.labeled_type_constraints[type_var];
+        Set<ast::Type> set = std::move(it->second);
         context.type_inference.labeled_type_constraints.erase(it);
-
-        if (context.type_inference.labeled_type_constraints.find(new_type) == context.type_inference.labeled_type_constraints.end()) {
-            context.type_inference.labeled_type_constraints[new_type] = set;
-        }
-        else {
-            for (auto type: set.elements) {
-                context.type_inference.labeled_type_constraints[new_type].insert(type);
-            }
-        }
+        semantic::add_labeled_type_constraint(context, new_type, set);
     }
 }
 
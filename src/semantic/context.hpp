@@ -45,12 +45,12 @@ namespace semantic {
 
     // Scopes
     struct Scope {
-        std::unordered_map<std::string, Binding>& variables_scope;
-        FunctionsAndTypesScope& functions_and_types_scope;
+        std::unordered_map<symbol::Symbol, Binding>& variables_scope;
+        const FunctionsAndTypesScope& functions_and_types_scope;
     };
 
     struct Scopes {
-        std::vector<std::unordered_map<std::string, Binding>> variables_scopes;
+        std::vector<std::unordered_map<symbol::Symbol, Binding>> variables_scopes;
         semantic::FunctionsAndTypesScopes functions_and_types_scopes;
     };
 
@@ -59,6 +59,7 @@ namespace semantic {
         size_t current_type_variable_number = 1;
         std::vector<Set<ast::Type>> type_constraints;
         std::unordered_map<ast::Type, Set<ast::Type>> labeled_type_constraints;
+        std::unordered_map<ast::Type, ast::Type> labels; // Label of each type in labeled_type_constraints
         std::unordered_map<ast::Type, Set<ast::InterfaceType>> interface_constraints;
         std::unordered_map<ast::Type, ast::FieldTypes> field_constraints;
         std::unordered_map<ast::Type, std::vector<ast::Type>> parameter_constraints;
@@ -82,7 +83,7 @@ namespace semantic {
     Result<Ok, Error> add_scope(Context& context, ast::BlockNode& block);
     void remove_scope(Context& context);
     Scope current_scope(Context& context);
-    std::optional<Binding> get_binding(Context& context, std::string identifier);
+    std::optional<Binding> get_binding(Context& context, symbol::Symbol identifier);
 
     // Work with modules
     Scopes get_definitions(Context& context);
@@ -95,6 +96,7 @@ namespace semantic {
 
     // For unify and analyze
     ast::Type new_final_type_variable(Context& context);
+    void add_labeled_type_constraint(Context& context, ast::Type label, const Set<ast::Type>& types);
     ast::Type get_unified_type(Context& context, ast::Type type_var);
     void set_unified_type(Context& context, ast::Type type_var, ast::Type new_type);
 
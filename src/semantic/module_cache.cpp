@@ -0,0 +1,640 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <type_traits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "module_cache.hpp"
+#include "intrinsics.hpp"
+#include "../semantic.hpp"
+#include "../utilities.hpp"
+#include "../trace.hpp"
+
+// Keys
+// ----
+static const uint32_t cache_magic = 0x43444d44; // "DMDC"
+static const uint32_t cache_format_version = 2;
+
+using utilities::hash_bytes;
+using utilities::hash_string;
+using utilities::hash_value;
+
+static uint64_t get_compiler_version() {
+    return hash_value(cache_format_version, utilities::get_compiler_version());
+}
+
+static uint64_t get_file_key(const std::filesystem::path& module_path, const std::string& source) {
+    return hash_string(source, hash_string(module_path.string(), get_compiler_version()));
+}
+
+static std::optional<std::filesystem::path> get_cache_file(uint64_t key) {
+    auto directory = utilities::get_cache_directory();
+    if (!directory.has_value()) return std::nullopt;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.dmc", (unsigned long long) key);
+    return directory.value() / "modules" / name;
+}
+
+// Returns nullopt if a dependency can't be found
+static std::optional<std::vector<std::filesystem::path>> get_dependencies(ast::Ast& ast, const std::filesystem::path& module_path) {
+    std::vector<std::filesystem::path> dependencies;
+    if (!std_libs.contains(module_path)) {
+        dependencies.assign(std_libs.elements.begin(), std_libs.elements.end());
+    }
+    for (auto& use_stmt: ast.modules[module_path.string()]->use_statements) {
+        std::error_code error;
+        dependencies.push_back(std::filesystem::canonical(module_path.parent_path() / (use_stmt->path->value + ".dmd"), error));
+        if (error) return std::nullopt;
+    }
+    return dependencies;
+}
+
+static ast::TypeNode* find_type(std::vector<ast::TypeNode*>& types, symbol::Symbol identifier) {
+    for (auto type: types) {
+        if (type->identifier->value == identifier) return type;
+        if (auto found = find_type(type->cases, identifier)) return found;
+    }
+    return nullptr;
+}
+
+// Mapped file
+// -----------
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    std::string buffer;
+
+    MappedFile(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return;
+        this->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        this->data = this->buffer.data();
+        this->size = this->buffer.size();
+    }
+    ~MappedFile() {}
+#else
+    MappedFile(const std::filesystem::path& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                this->data = (const char*) data;
+                this->size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (this->data) munmap((void*) this->data, this->size);
+    }
+#endif
+};
+
+// Serialization
+// -------------
+// Nodes are stored in a table and point to each other by index, 0 being
+// null. Both directions go through the same field lists below.
+template <class Archive> void fields(Archive& ar, ast::BlockNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.statements); ar(node.use_statements); ar(node.functions); ar(node.interfaces); ar(node.types);}
+template <class Archive> void fields(Archive& ar, ast::FunctionArgumentNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.is_mutable); ar(node.identifier);}
+template <class Archive> void fields(Archive& ar, ast::FunctionNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.identifier); ar(node.type_parameters); ar(node.args); ar(node.body); ar(node.state); ar(node.is_extern); ar(node.is_extern_and_variadic); ar(node.is_builtin); ar(node.is_used); ar(node.is_analyzed); ar(node.return_type); ar(node.return_type_is_mutable); ar(node.module_path);}
+template <class Archive> void fields(Archive& ar, ast::InterfaceNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.identifier); ar(node.type_parameters); ar(node.args); ar(node.return_type); ar(node.return_type_is_mutable); ar(node.module_path);}
+template <class Archive> void fields(Archive& ar, ast::TypeNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.identifier); ar(node.fields); ar(node.cases); ar(node.module_path);}
+template <class Archive> void fields(Archive& ar, ast::DeclarationNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.is_mutable); ar(node.identifier); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::AssignmentNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.assignable); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::ReturnNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::BreakNode& node) {ar(node.line); ar(node.column); ar(node.type);}
+template <class Archive> void fields(Archive& ar, ast::ContinueNode& node) {ar(node.line); ar(node.column); ar(node.type);}
+template <class Archive> void fields(Archive& ar, ast::IfElseNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.condition); ar(node.if_branch); ar(node.else_branch);}
+template <class Archive> void fields(Archive& ar, ast::WhileNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.condition); ar(node.block);}
+template <class Archive> void fields(Archive& ar, ast::UseNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.path); ar(node.include);}
+template <class Archive> void fields(Archive& ar, ast::LinkWithNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.directives);}
+template <class Archive> void fields(Archive& ar, ast::CallArgumentNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.is_mutable); ar(node.identifier); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::CallNode& node) {ar(node.line); ar(node.end_line); ar(node.column); ar(node.type); ar(node.identifier); ar(node.args);}
+template <class Archive> void fields(Archive& ar, ast::StructLiteralNode& node) {ar(node.line); ar(node.end_line); ar(node.column); ar(node.type); ar(node.identifier); ar(node.fields);}
+template <class Archive> void fields(Archive& ar, ast::FloatNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.value);}
+template <class Archive> void fields(Archive& ar, ast::IntegerNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.value);}
+template <class Archive> void fields(Archive& ar, ast::IdentifierNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.value);}
+template <class Archive> void fields(Archive& ar, ast::BooleanNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.value);}
+template <class Archive> void fields(Archive& ar, ast::StringNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.value);}
+template <class Archive> void fields(Archive& ar, ast::InterpolatedStringNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.strings); ar(node.expressions);}
+template <class Archive> void fields(Archive& ar, ast::ArrayNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.elements);}
+template <class Archive> void fields(Archive& ar, ast::FieldAccessNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.accessed); ar(node.fields_accessed);}
+template <class Archive> void fields(Archive& ar, ast::AddressOfNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::DereferenceNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.expression);}
+template <class Archive> void fields(Archive& ar, ast::NewNode& node) {ar(node.line); ar(node.column); ar(node.type); ar(node.expression);}
+
+template <class Archive> void fields(Archive& ar, ast::FieldConstraint& field) {ar(field.name); ar(field.type);}
+template <class Archive> void fields(Archive& ar, ast::TypeParameter& parameter) {ar(parameter.type); ar(parameter.interface);}
+
+template <size_t I = 0>
+static ast::Node make_node(uint8_t kind) {
+    if constexpr (I + 1 < std::variant_size_v<ast::Node>) {
+        if (kind != I) return make_node<I + 1>(kind);
+    }
+    return ast::Node(std::in_place_index<I>);
+}
+
+struct Writer {
+    std::filesystem::path module_path;
+    std::string kinds;
+    std::string records;
+    std::unordered_map<ast::Node*, uint32_t> indices;
+    std::vector<ast::Node*> nodes;
+
+    void write(const void* data, size_t size) {this->records.append((const char*) data, size);}
+
+    template <class T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>, int> = 0>
+    void operator()(T& value) {this->write(&value, sizeof(value));}
+
+    void operator()(std::string& string) {
+        uint32_t size = string.size();
+        (*this)(size);
+        this->write(string.data(), size);
+    }
+    void operator()(symbol::Symbol& symbol) {std::string string = symbol.str(); (*this)(string);}
+    void operator()(std::filesystem::path& path) {std::string string = path.string(); (*this)(string);}
+
+    template <class T>
+    void operator()(T*& node) {
+        uint32_t index = 0;
+        if (node) {
+            auto it = this->indices.find((ast::Node*) node);
+            if (it == this->indices.end()) {
+                it = this->indices.insert({(ast::Node*) node, this->nodes.size() + 1}).first;
+                this->nodes.push_back((ast::Node*) node);
+                this->kinds.push_back(((ast::Node*) node)->index());
+            }
+            index = it->second;
+        }
+        (*this)(index);
+    }
+
+    template <class T>
+    void operator()(std::vector<T>& elements) {
+        uint32_t size = elements.size();
+        (*this)(size);
+        for (auto& element: elements) (*this)(element);
+    }
+
+    template <class T>
+    void operator()(std::optional<T>& value) {
+        bool has_value = value.has_value();
+        (*this)(has_value);
+        if (has_value) (*this)(value.value());
+    }
+
+    template <class T>
+    void operator()(Set<T>& set) {
+        std::vector<T> elements(set.elements.begin(), set.elements.end());
+        (*this)(elements);
+    }
+
+    void operator()(std::unordered_map<ast::IdentifierNode*, ast::Node*>& map) {
+        uint32_t size = map.size();
+        (*this)(size);
+        for (auto it: map) {
+            ast::IdentifierNode* identifier = it.first;
+            (*this)(identifier);
+            (*this)(it.second);
+        }
+    }
+
+    void operator()(ast::InterfaceType& interface) {(*this)(interface.name);}
+    void operator()(ast::FieldConstraint& field) {fields(*this, field);}
+    void operator()(ast::TypeParameter& parameter) {fields(*this, parameter);}
+    void operator()(ast::FieldTypes& field_types) {(*this)(field_types.fields);}
+
+    void operator()(ast::Type& type) {
+        uint8_t variant = type.type.index();
+        (*this)(variant);
+        switch (variant) {
+            case ast::NoTypeVariant: break;
+            case ast::TypeVariableVariant: {
+                uint64_t id = type.as_type_variable().id;
+                (*this)(id);
+                break;
+            }
+            case ast::FinalTypeVariableVariant: {
+                auto& final_type_variable = type.as_final_type_variable();
+                (*this)(final_type_variable.id);
+                (*this)(final_type_variable.field_constraints);
+                (*this)(final_type_variable.parameter_constraints);
+                break;
+            }
+            case ast::NominalTypeVariant: {
+                auto& nominal_type = type.as_nominal_type();
+                (*this)(nominal_type.name);
+                (*this)(nominal_type.parameters);
+
+                // Type definitions from other modules are stored by name
+                uint8_t location = nominal_type.type_definition == nullptr ? 0 : nominal_type.type_definition->module_path == this->module_path ? 1 : 2;
+                (*this)(location);
+                if (location == 1) (*this)(nominal_type.type_definition);
+                if (location == 2) {
+                    (*this)(nominal_type.type_definition->module_path);
+                    (*this)(nominal_type.type_definition->identifier->value);
+                }
+                break;
+            }
+            case ast::StructTypeVariant: {
+                auto& struct_type = type.as_struct_type();
+                (*this)(struct_type.open);
+                (*this)(struct_type.fields);
+                break;
+            }
+            default: assert(false);
+        }
+    }
+};
+
+struct Reader {
+    ast::Ast& ast;
+    const char* position;
+    const char* end;
+    std::vector<ast::Node*> nodes;
+    bool failed = false;
+
+    Reader(ast::Ast& ast, const char* data, size_t size) : ast(ast), position(data), end(data + size) {}
+
+    const char* read(size_t size) {
+        if (this->failed || (size_t) (this->end - this->position) < size) {
+            this->failed = true;
+            return nullptr;
+        }
+        const char* data = this->position;
+        this->position += size;
+        return data;
+    }
+
+    template <class T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>, int> = 0>
+    void operator()(T& value) {
+        const char* data = this->read(sizeof(value));
+        if (data) std::memcpy(&value, data, sizeof(value));
+    }
+
+    void operator()(std::string& string) {
+        uint32_t size = 0;
+        (*this)(size);
+        const char* data = this->read(size);
+        if (data) string.assign(data, size);
+    }
+    void operator()(symbol::Symbol& symbol) {
+        uint32_t size = 0;
+        (*this)(size);
+        const char* data = this->read(size);
+        if (data) symbol = symbol::intern(std::string_view(data, size));
+    }
+    void operator()(std::filesystem::path& path) {std::string string; (*this)(string); path = string;}
+
+    template <class T>
+    void operator()(T*& node) {
+        uint32_t index = 0;
+        (*this)(index);
+        node = nullptr;
+        if (index == 0) return;
+        if (index > this->nodes.size()) {
+            this->failed = true;
+            return;
+        }
+
+        ast::Node* result = this->nodes[index - 1];
+        if constexpr (!std::is_same_v<T, ast::Node>) {
+            if (!std::holds_alternative<T>(*result)) {
+                this->failed = true;
+                return;
+            }
+        }
+        node = (T*) result;
+    }
+
+    template <class T>
+    void operator()(std::vector<T>& elements) {
+        uint32_t size = 0;
+        (*this)(size);
+        if (size > (size_t) (this->end - this->position)) {
+            this->failed = true;
+            return;
+        }
+        elements.clear();
+        elements.reserve(size);
+        for (uint32_t i = 0; i < size && !this->failed; i++) {
+            elements.push_back(this->make_default<T>());
+            (*this)(elements.back());
+        }
+    }
+
+    template <class T>
+    void operator()(std::optional<T>& value) {
+        bool has_value = false;
+        (*this)(has_value);
+        value = std::nullopt;
+        if (has_value) {
+            value = this->make_default<T>();
+            (*this)(value.value());
+        }
+    }
+
+    template <class T>
+    void operator()(Set<T>& set) {
+        std::vector<T> elements;
+        (*this)(elements);
+        set = Set<T>(elements);
+    }
+
+    void operator()(std::unordered_map<ast::IdentifierNode*, ast::Node*>& map) {
+        uint32_t size = 0;
+        (*this)(size);
+        for (uint32_t i = 0; i < size && !this->failed; i++) {
+            ast::IdentifierNode* identifier = nullptr;
+            ast::Node* expression = nullptr;
+            (*this)(identifier);
+            (*this)(expression);
+            map[identifier] = expression;
+        }
+    }
+
+    void operator()(ast::InterfaceType& interface) {(*this)(interface.name);}
+    void operator()(ast::FieldConstraint& field) {fields(*this, field);}
+    void operator()(ast::TypeParameter& parameter) {fields(*this, parameter);}
+    void operator()(ast::FieldTypes& field_types) {(*this)(field_types.fields);}
+
+    void operator()(ast::Type& type) {
+        uint8_t variant = ast::NoTypeVariant;
+        (*this)(variant);
+        switch (variant) {
+            case ast::NoTypeVariant: {
+                type = ast::Type(ast::NoType{});
+                break;
+            }
+            case ast::TypeVariableVariant: {
+                uint64_t id = 0;
+                (*this)(id);
+                type = ast::Type(ast::TypeVariable(id));
+                break;
+            }
+            case ast::FinalTypeVariableVariant: {
+                ast::FinalTypeVariable final_type_variable("");
+                (*this)(final_type_variable.id);
+                (*this)(final_type_variable.field_constraints);
+                (*this)(final_type_variable.parameter_constraints);
+                type = ast::Type(final_type_variable);
+                break;
+            }
+            case ast::NominalTypeVariant: {
+                ast::NominalType nominal_type("");
+                (*this)(nominal_type.name);
+                (*this)(nominal_type.parameters);
+
+                uint8_t location = 0;
+                (*this)(location);
+                if (location == 1) {
+                    (*this)(nominal_type.type_definition);
+                }
+                else if (location == 2) {
+                    std::filesystem::path module_path;
+                    symbol::Symbol identifier;
+                    (*this)(module_path);
+                    (*this)(identifier);
+
+                    auto module = this->ast.modules.find(module_path.string());
+                    if (module != this->ast.modules.end()) {
+                        nominal_type.type_definition = find_type(module->second->types, identifier);
+                    }
+                    if (nominal_type.type_definition == nullptr) this->failed = true;
+                }
+                type = ast::Type(nominal_type);
+                break;
+            }
+            case ast::StructTypeVariant: {
+                ast::StructType struct_type(ast::FieldTypes{});
+                (*this)(struct_type.open);
+                (*this)(struct_type.fields);
+                type = ast::Type(struct_type);
+                break;
+            }
+            default: this->failed = true;
+        }
+    }
+
+    template <class T>
+    T make_default() {
+        if constexpr (std::is_pointer_v<T>) return nullptr;
+        else                                return T();
+    }
+};
+
+// Load and save
+// -------------
+static bool read_header(Reader& reader, uint64_t key, const std::filesystem::path& module_path) {
+    uint32_t magic = 0, format_version = 0;
+    uint64_t version = 0, file_key = 0, checksum = 0;
+    std::string path;
+    reader(magic);
+    reader(format_version);
+    reader(version);
+    reader(file_key);
+    reader(checksum);
+    if (reader.failed || checksum != hash_bytes(reader.position, reader.end - reader.position, key)) return false;
+    reader(path);
+    return !reader.failed
+        && magic == cache_magic
+        && format_version == cache_format_version
+        && version == get_compiler_version()
+        && file_key == key
+        && path == module_path.string();
+}
+
+std::optional<std::vector<std::filesystem::path>> semantic::get_cached_module_dependencies(const std::filesystem::path& module_path, const std::string& source) {
+    uint64_t key = get_file_key(module_path, source);
+    auto file = get_cache_file(key);
+    if (!file.has_value()) return std::nullopt;
+
+    MappedFile mapped(file.value());
+    if (mapped.data == nullptr) return std::nullopt;
+    ast::Ast ast;
+    Reader reader(ast, mapped.data, mapped.size);
+    if (!read_header(reader, key, module_path)) return std::nullopt;
+
+    std::vector<std::filesystem::path> dependencies;
+    uint32_t size = 0;
+    reader(size);
+    for (uint32_t i = 0; i < size && !reader.failed; i++) {
+        std::filesystem::path dependency;
+        uint64_t dependency_hash = 0;
+        reader(dependency);
+        reader(dependency_hash);
+        dependencies.push_back(dependency);
+    }
+    if (reader.failed) return std::nullopt;
+    return dependencies;
+}
+
+Result<bool, Errors> semantic::load_module_from_cache(ast::Ast& ast, std::filesystem::path module_path, const std::string& source) {
+    trace::Span span("Load module from cache", [&] {return module_path.string();});
+    uint64_t key = get_file_key(module_path, source);
+    auto file = get_cache_file(key);
+    if (!file.has_value()) return false;
+
+    MappedFile mapped(file.value());
+    if (mapped.data == nullptr) return false;
+    Reader reader(ast, mapped.data, mapped.size);
+    if (!read_header(reader, key, module_path)) return false;
+
+    // Load dependencies and check they didn't change
+    uint64_t module_hash = key;
+    uint32_t dependencies = 0;
+    reader(dependencies);
+    for (uint32_t i = 0; i < dependencies && !reader.failed; i++) {
+        std::filesystem::path dependency;
+        uint64_t dependency_hash = 0;
+        reader(dependency);
+        reader(dependency_hash);
+        if (reader.failed) return false;
+
+        auto result = semantic::load_module(ast, dependency);
+        if (result.is_error()) return result.get_error();
+
+        auto it = ast.module_hashes.find(dependency.string());
+        if (it == ast.module_hashes.end() || it->second != dependency_hash) return false;
+        module_hash = hash_value(dependency_hash, module_hash);
+    }
+    if (ast.modules.find(module_path.string()) != ast.modules.end()) return true;
+
+    std::vector<std::string> link_with;
+    reader(link_with);
+
+    // Create nodes before reading them so they can point to each other
+    uint32_t size = 0;
+    reader(size);
+    const char* kinds = reader.read(size);
+    if (reader.failed || size == 0 || kinds[0] != ast::Block) return false;
+    for (uint32_t i = 0; i < size; i++) {
+        if ((uint8_t) kinds[i] >= std::variant_size_v<ast::Node>) return false;
+    }
+
+    // Nodes go in their own ast until the whole module is read, so a
+    // module that fails to load doesn't leave nodes behind
+    ast::Ast module_ast;
+    reader.nodes.reserve(size);
+    for (uint32_t i = 0; i < size; i++) {
+        module_ast.push_back(make_node(kinds[i]));
+        reader.nodes.push_back(module_ast.last_element());
+    }
+    for (uint32_t i = 0; i < size && !reader.failed; i++) {
+        std::visit([&reader](auto& node) {fields(reader, node);}, *reader.nodes[i]);
+    }
+    if (reader.failed || reader.position != reader.end) {
+        module_ast.free();
+        return false;
+    }
+
+    // Functions have to be checked again when they are used, only extern
+    // declarations keep being used
+    for (auto node: reader.nodes) {
+        if (node->index() == ast::Function && !std::get<ast::FunctionNode>(*node).is_extern) {
+            std::get<ast::FunctionNode>(*node).is_used = false;
+        }
+    }
+
+    // Add module
+    ast.merge(module_ast);
+    ast.modules[module_path.string()] = (ast::BlockNode*) reader.nodes[0];
+    ast.module_hashes[module_path.string()] = module_hash;
+    ast.link_with.insert(ast.link_with.end(), link_with.begin(), link_with.end());
+    return true;
+}
+
+void semantic::save_module_to_cache(ast::Ast& ast, std::filesystem::path module_path, const std::string& source, std::vector<std::string> link_with) {
+    uint64_t key = get_file_key(module_path, source);
+
+    // Only modules whose dependencies can be cached can be cached
+    auto found_dependencies = get_dependencies(ast, module_path);
+    if (!found_dependencies.has_value()) return;
+    auto& dependencies = found_dependencies.value();
+
+    std::vector<uint64_t> dependencies_hashes;
+    uint64_t module_hash = key;
+    for (auto& dependency: dependencies) {
+        auto it = ast.module_hashes.find(dependency.string());
+        if (it == ast.module_hashes.end()) return;
+        dependencies_hashes.push_back(it->second);
+        module_hash = hash_value(it->second, module_hash);
+    }
+    ast.module_hashes[module_path.string()] = module_hash;
+
+    auto file = get_cache_file(key);
+    if (!file.has_value()) return;
+
+    // Serialize nodes
+    Writer nodes;
+    nodes.module_path = module_path;
+    ast::BlockNode* block = ast.modules[module_path.string()];
+    nodes(block);
+    nodes.records.clear(); // The root is always the first node
+    for (size_t i = 0; i < nodes.nodes.size(); i++) {
+        std::visit([&nodes](auto& node) {fields(nodes, node);}, *nodes.nodes[i]);
+    }
+
+    // Write header
+    Writer writer;
+    std::string path = module_path.string();
+    writer(path);
+
+    uint32_t size = dependencies.size();
+    writer(size);
+    for (size_t i = 0; i < dependencies.size(); i++) {
+        writer(dependencies[i]);
+        writer(dependencies_hashes[i]);
+    }
+    writer(link_with);
+
+    size = nodes.nodes.size();
+    writer(size);
+    writer.records += nodes.kinds;
+    writer.records += nodes.records;
+
+    // Add checksum, so damaged files are not used
+    Writer header;
+    uint32_t magic = cache_magic, format_version = cache_format_version;
+    uint64_t version = get_compiler_version();
+    uint64_t checksum = hash_bytes(writer.records.data(), writer.records.size(), key);
+    header(magic);
+    header(format_version);
+    header(version);
+    header(key);
+    header(checksum);
+    writer.records.insert(0, header.records);
+
+    // Write to a temporary file first so readers never see partial files
+    std::error_code error;
+    std::filesystem::create_directories(file.value().parent_path(), error);
+    if (error) return;
+
+    auto temporary = file.value();
+    temporary += ".tmp" + std::to_string(std::random_device()());
+    {
+        std::ofstream stream(temporary, std::ios::binary);
+        if (!stream.is_open()) return;
+        stream.write(writer.records.data(), writer.records.size());
+        if (!stream) {
+            stream.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, file.value(), error);
+    if (error) std::filesystem::remove(temporary, error);
+}
@@ -0,0 +1,31 @@
+#ifndef SEMANTIC_MODULE_CACHE_HPP
+#define SEMANTIC_MODULE_CACHE_HPP
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../ast.hpp"
+#include "../shared.hpp"
+
+namespace semantic {
+    // Analyzed modules are saved in the cache directory, in a file named
+    // after the compiler build, the module path and its content. A cached
+    // module is only used if the modules it depends on didn't change either,
+    // so modules that are part of an import cycle are never cached.
+    //
+    // Cached modules are loaded as they were right after being analyzed,
+    // without the specializations and uses added by other modules. Those
+    // are added again as the functions get used, codegen emits modules and
+    // specializations sorted so the result is the same as without cache.
+    Result<bool, Errors> load_module_from_cache(ast::Ast& ast, std::filesystem::path module_path, const std::string& source);
+    void save_module_to_cache(ast::Ast& ast, std::filesystem::path module_path, const std::string& source, std::vector<std::string> link_with);
+
+    // Modules a cached module was analyzed with, or nullopt if it isn't
+    // cached. Only reads the header, so modules can be looked up before
+    // deciding whether they have to be parsed.
+    std::optional<std::vector<std::filesystem::path>> get_cached_module_dependencies(const std::filesystem::path& module_path, const std::string& source);
+}
+
+#endif
@@ -1,16 +1,34 @@
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "scopes.hpp"
 #include "intrinsics.hpp"
+#include "module_cache.hpp"
 #include "../lexer.hpp"
+#include "../trace.hpp"
+#include "../parser.hpp"
 #include "../semantic.hpp"
 
+// Paths of used modules are resolved from the directory of the module
+// using them. A missing module is an error, not an exception.
+static Result<std::filesystem::path, Errors> get_use_path(std::filesystem::path directory, ast::UseNode& use_stmt) {
+    auto path = directory / (use_stmt.path->value + ".dmd");
+
+    std::error_code error;
+    auto canonical_path = std::filesystem::canonical(path, error);
+    if (error) return Errors{errors::file_couldnt_be_found(path)};
+    return canonical_path;
+}
+
 void semantic::FunctionsAndTypesScopes::add_scope() {
-    this->scopes.push_back(std::unordered_map<std::string, ast::Node*>());
+    this->scopes.push_back(std::make_shared<FunctionsAndTypesScope>());
 }
 
 void semantic::FunctionsAndTypesScopes::remove_scope() {
-    for (auto binding: this->current_scope()) {
+    for (auto& binding: std::as_const(*this->scopes.back())) {
         if (binding.second->index() == ast::Interface) {
             ((ast::InterfaceNode*)binding.second)->functions = {};
         }
@@ -18,15 +36,26 @@ void semantic::FunctionsAndTypesScopes::remove_scope() {
 
     this->scopes.pop_back();
 }
-std::unordered_map<std::string, ast::Node*>& semantic::FunctionsAndTypesScopes::current_scope() {
+
+semantic::FunctionsAndTypesScope& semantic::FunctionsAndTypesScopes::current_scope() {
     assert(this->scopes.size() != 0);
-    return this->scopes[this->scopes.size() - 1];
+    auto& scope = this->scopes.back();
+    if (scope.use_count() > 1) {
+        scope = std::make_shared<FunctionsAndTypesScope>(*scope);
+    }
+    return *scope;
 }
 
-ast::Node* semantic::FunctionsAndTypesScopes::get_binding(std::string identifier) {
+const semantic::FunctionsAndTypesScope& semantic::FunctionsAndTypesScopes::current_scope() const {
+    assert(this->scopes.size() != 0);
+    return *this->scopes.back();
+}
+
+ast::Node* semantic::FunctionsAndTypesScopes::get_binding(symbol::Symbol identifier) {
     for (auto scope = this->scopes.rbegin(); scope != this->scopes.rend(); scope++) {
-        if (scope->find(identifier) != scope->end()) {
-            return (*scope)[identifier];
+        auto it = (*scope)->find(identifier);
+        if (it != (*scope)->end()) {
+            return it->second;
         }
     }
     return nullptr;
@@ -105,7 +134,7 @@ Result<Ok, Errors> semantic::FunctionsAndTypesScopes::add_definitions_from_block
     // Add std libs
     if (this->scopes.size() == 0) {
         this->add_scope();
-        if (std::find(std_libs.elements.begin(), std_libs.elements.end(), module_path) == std_libs.elements.end()) {
+        if (!std_libs.contains(module_path)) {
             for (auto path: std_libs.elements) {
                 this->add_module_functions(ast, path, already_included_modules);
             }
@@ -118,9 +147,10 @@ Result<Ok, Errors> semantic::FunctionsAndTypesScopes::add_definitions_from_block
     // Add functions from modules
     auto current_directory = module_path.parent_path();
     for (auto& use_stmt: block.use_statements) {
-        auto module_path = std::filesystem::canonical(current_directory / (use_stmt->path->value + ".dmd"));
-        assert(std::filesystem::exists(module_path));
-        auto result = this->add_module_functions(ast, module_path, already_included_modules);
+        auto module_path = get_use_path(current_directory, *use_stmt);
+        if (module_path.is_error()) return module_path.get_error();
+
+        auto result = this->add_module_functions(ast, module_path.get_value(), already_included_modules);
         if (result.is_error()) return result;
     }
 
@@ -132,40 +162,8 @@ Result<Ok, Errors> semantic::FunctionsAndTypesScopes::add_definitions_from_block
 }
 
 Result<Ok, Errors> semantic::FunctionsAndTypesScopes::add_module_functions(ast::Ast& ast, std::filesystem::path module_path, std::set<std::filesystem::path>& already_included_modules) {
-    if (ast.modules.find(module_path.string()) == ast.modules.end()) {
-        // Read file
-        Result<std::string, Error> result = utilities::read_file(module_path.string());
-        if (result.is_error()) {
-            std::cout << result.get_error().value;
-            exit(EXIT_FAILURE);
-        }
-        std::string file = result.get_value();
-
-        // Lex
-        auto tokens = lexer::lex(module_path);
-        if (tokens.is_error()) {
-            for (size_t i = 0; i < tokens.get_error().size(); i++) {
-                std::cout << tokens.get_error()[i].value << "\n";
-            }
-            exit(EXIT_FAILURE);
-        }
-
-        // Parse module and add it to the ast
-        auto parsing_result = parse::module(ast, tokens.get_value(), module_path);
-        if (parsing_result.is_error()) {
-            std::vector<Error> errors = parsing_result.get_errors();
-            for (size_t i = 0; i < errors.size(); i++) {
-                std::cout << errors[i].value << '\n';
-            }
-            exit(EXIT_FAILURE);
-        }
-
-        // Analyze new module added
-        auto analyze_result = semantic::analyze_module(ast, module_path);
-        if (analyze_result.is_error()) {
-            return analyze_result.get_error();
-        }
-    }
+    auto result = semantic::load_module(ast, module_path);
+    if (result.is_error()) return result;
 
     if (already_included_modules.find(module_path) == already_included_modules.end()) {
         this->add_definitions_to_current_scope(
@@ -179,12 +177,233 @@ Result<Ok, Errors> semantic::FunctionsAndTypesScopes::add_module_functions(ast::
         // Add includes
         for (auto& use_stmt: ast.modules[module_path.string()]->use_statements) {
             if (use_stmt->include) {
-                auto include_path = std::filesystem::canonical(module_path.parent_path() / (use_stmt->path->value + ".dmd"));
-                auto result = this->add_module_functions(ast, include_path, already_included_modules);
+                auto include_path = get_use_path(module_path.parent_path(), *use_stmt);
+                if (include_path.is_error()) return include_path.get_error();
+
+                auto result = this->add_module_functions(ast, include_path.get_value(), already_included_modules);
                 if (result.is_error()) return result;
             }
         }
     }
 
     return Ok {};
-}
\ No newline at end of file
+}
+
+// Module loading
+// --------------
+// Lexes and parses a module into its own ast, so modules can be parsed
+// in different threads and merged later.
+static ast::ParsedModule parse_module(ast::Ast& module_ast, std::filesystem::path module_path, std::string source) {
+    ast::ParsedModule parsed;
+    parsed.source = std::move(source);
+
+    // Lex
+    auto tokens = lexer::lex(parsed.source, module_path);
+    if (tokens.is_error()) {
+        for (auto& error: tokens.get_error()) {
+            parsed.errors.push_back(error.value);
+        }
+        return parsed;
+    }
+
+    // Parse
+    auto parsing_result = parse::module(module_ast, tokens.get_value(), module_path);
+    if (parsing_result.is_error()) {
+        for (auto& error: parsing_result.get_errors()) {
+            parsed.errors.push_back(error.value);
+        }
+        return parsed;
+    }
+
+    parsed.block = module_ast.modules[module_path.string()];
+    parsed.link_with = module_ast.link_with;
+    return parsed;
+}
+
+// Modules are parsed by a pool of threads, starting from the std libs
+// and the modules used by the program. Each parsed module adds the
+// modules it uses to the queue. Modules found in the module cache are
+// not parsed, they add the modules they were cached with instead.
+struct ModuleParser {
+    ast::Ast& ast;
+    size_t max_threads;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::filesystem::path> queue;
+    std::set<std::filesystem::path> seen;
+    std::vector<std::thread> threads;
+    size_t busy = 0;
+    size_t waiting = 0;
+
+    ModuleParser(ast::Ast& ast, size_t max_threads) : ast(ast), max_threads(max_threads) {}
+
+    // Must be called with the mutex locked
+    void add(std::filesystem::path module_path) {
+        if (this->ast.modules.find(module_path.string()) != this->ast.modules.end()) return;
+        if (this->ast.parsed_modules.find(module_path.string()) != this->ast.parsed_modules.end()) return;
+        if (!this->seen.insert(module_path).second) return;
+
+        this->queue.push_back(module_path);
+        if (this->waiting > 0) {
+            this->condition.notify_one();
+        }
+        else if (this->threads.size() + 1 < this->max_threads) {
+            this->threads.push_back(std::thread([this] { this->work(); }));
+        }
+    }
+
+    // Must be called with the mutex locked
+    void add_uses(std::filesystem::path module_path, ast::BlockNode& block) {
+        for (auto& use_stmt: block.use_statements) {
+            // Missing modules are reported when the module is analyzed
+            std::error_code error;
+            auto use_path = std::filesystem::canonical(module_path.parent_path() / (use_stmt->path->value + ".dmd"), error);
+            if (!error) this->add(use_path);
+        }
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (true) {
+            this->waiting++;
+            this->condition.wait(lock, [this] { return this->queue.size() > 0 || this->busy == 0; });
+            this->waiting--;
+            if (this->queue.size() == 0) break;
+
+            auto module_path = this->queue.back();
+            this->queue.pop_back();
+            this->busy++;
+            lock.unlock();
+
+            // Modules in the cache are loaded from it instead, so only the
+            // modules they depend on have to be looked at
+            auto source = utilities::read_file(module_path);
+            auto cached_dependencies = semantic::get_cached_module_dependencies(module_path, source);
+
+            ast::Ast module_ast;
+            ast::ParsedModule parsed;
+            if (cached_dependencies.has_value()) parsed.source = std::move(source);
+            else                                 parsed = parse_module(module_ast, module_path, std::move(source));
+
+            lock.lock();
+            if (cached_dependencies.has_value()) {
+                for (auto& dependency: cached_dependencies.value()) {
+                    this->add(dependency);
+                }
+            }
+            else {
+                this->ast.merge(module_ast);
+                if (parsed.block) this->add_uses(module_path, *parsed.block);
+            }
+            this->ast.parsed_modules[module_path.string()] = std::move(parsed);
+            this->busy--;
+        }
+
+        // Wake up the other threads so they can finish too
+        this->condition.notify_all();
+    }
+
+    void run() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!std_libs.contains(this->ast.module_path)) {
+                for (auto& path: std_libs.elements) {
+                    this->add(path);
+                }
+            }
+            this->add_uses(this->ast.module_path, *this->ast.program);
+        }
+
+        this->work();
+        for (auto& thread: this->threads) {
+            thread.join();
+        }
+    }
+};
+
+// Std analyzed ahead of time by load_prelude, it's moved into the first
+// program analyzed after it
+static std::atomic<ast::Ast*> prelude = nullptr;
+
+void semantic::load_prelude() {
+    trace::Span span("Load prelude");
+    static ast::Ast std_ast;
+    for (auto& path: std_libs.elements) {
+        if (semantic::load_module(std_ast, path).is_error()) return;
+    }
+    prelude = &std_ast;
+}
+
+static void add_prelude(ast::Ast& ast) {
+    if (std_libs.contains(ast.module_path)) return;
+    ast::Ast* std_ast = prelude.exchange(nullptr);
+    if (!std_ast) return;
+
+    for (auto& it: std_ast->modules) {
+        ast.modules[it.first] = it.second;
+    }
+    for (auto& it: std_ast->module_hashes) {
+        ast.module_hashes[it.first] = it.second;
+    }
+    ast.link_with.insert(ast.link_with.end(), std_ast->link_with.begin(), std_ast->link_with.end());
+    ast.merge(*std_ast);
+}
+
+void semantic::parse_modules(ast::Ast& ast) {
+    trace::Span span("Parse modules");
+    add_prelude(ast);
+
+    size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    ModuleParser(ast, max_threads).run();
+}
+
+Result<Ok, Errors> semantic::load_module(ast::Ast& ast, std::filesystem::path module_path) {
+    if (ast.modules.find(module_path.string()) != ast.modules.end()) return Ok {};
+    trace::Span span("Load module", [&] {return module_path.string();});
+
+    // Use the module parsed ahead if there is one
+    ast::ParsedModule parsed;
+    auto it = ast.parsed_modules.find(module_path.string());
+    if (it != ast.parsed_modules.end()) {
+        parsed = std::move(it->second);
+        ast.parsed_modules.erase(it);
+    }
+    else {
+        if (!std::filesystem::exists(module_path)) return Errors{errors::file_couldnt_be_found(module_path)};
+        parsed.source = utilities::read_file(module_path.string());
+    }
+
+    // Try to use the analyzed module from a previous compilation
+    auto cached = semantic::load_module_from_cache(ast, module_path, parsed.source);
+    if (cached.is_error()) return cached.get_error();
+    if (cached.get_value()) return Ok {};
+
+    // Lex and parse
+    if (!parsed.block && parsed.errors.size() == 0) {
+        ast::Ast module_ast;
+        parsed = parse_module(module_ast, module_path, std::move(parsed.source));
+        ast.merge(module_ast);
+    }
+    if (parsed.errors.size() > 0) {
+        Errors errors;
+        for (auto& error: parsed.errors) {
+            errors.push_back(Error{error});
+        }
+        return errors;
+    }
+
+    // Add it to the ast
+    ast.modules[module_path.string()] = parsed.block;
+    ast.link_with.insert(ast.link_with.end(), parsed.link_with.begin(), parsed.link_with.end());
+
+    // Analyze new module added
+    auto analyze_result = semantic::analyze_module(ast, module_path);
+    if (analyze_result.is_error()) {
+        return analyze_result.get_error();
+    }
+
+    // Save it for next time
+    semantic::save_module_to_cache(ast, module_path, parsed.source, parsed.link_with);
+    return Ok {};
+}
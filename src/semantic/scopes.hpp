@@ -2,6 +2,8 @@
 #define SEMANTIC_FUNCTION_SCOPES_HPP
 
 #include <iostream>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include <set>
@@ -10,15 +12,19 @@
 #include "../utilities.hpp"
 
 namespace semantic {
-    using FunctionsAndTypesScope = std::unordered_map<std::string, ast::Node*>;
+    using FunctionsAndTypesScope = std::unordered_map<symbol::Symbol, ast::Node*>;
 
+    // Scopes are shared between copies, so copying the definitions visible
+    // from a function only copies pointers. A scope is copied the first time
+    // it's modified while shared.
     struct FunctionsAndTypesScopes {
-        std::vector<FunctionsAndTypesScope> scopes;
+        std::vector<std::shared_ptr<FunctionsAndTypesScope>> scopes;
 
         void add_scope();
         void remove_scope();
         FunctionsAndTypesScope& current_scope();
-        ast::Node* get_binding(std::string identifier);
+        const FunctionsAndTypesScope& current_scope() const;
+        ast::Node* get_binding(symbol::Symbol identifier);
 
         Result<Ok, Error> add_definitions_to_current_scope(std::vector<ast::FunctionNode*>& functions, std::vector<ast::InterfaceNode*>& interfaces, std::vector<ast::TypeNode*>& types);
         Result<Ok, Errors> add_definitions_from_block_to_scope(ast::Ast& ast, std::filesystem::path module_path, ast::BlockNode& block);
@@ -5,6 +5,7 @@
 #include "../utilities.hpp"
 #include "intrinsics.hpp"
 #include "check_functions_used.hpp"
+#include "../trace.hpp"
 
 // Helper functions
 // ----------------
@@ -41,11 +42,16 @@ void add_type_parameters(semantic::Context& context, ast::FunctionNode& node, as
 // Semantic analysis
 // -----------------
 Result<Ok, Errors> semantic::analyze(ast::Ast& ast) {
+    trace::Span span("Analyze");
     semantic::Context context;
     context.init_with(&ast);
 
+    // Parse the modules used while they can be parsed in parallel
+    semantic::parse_modules(ast);
+
     // Analyze program
     semantic::analyze(context, *ast.program);
+    trace::record_peak_memory();
 
     // Return
     if (context.errors.size() > 0) return context.errors;
@@ -53,6 +59,7 @@ Result<Ok, Errors> semantic::analyze(ast::Ast& ast) {
 }
 
 Result<Ok, Errors> semantic::analyze_module(ast::Ast& ast, std::filesystem::path module_path) {
+    trace::Span span("Analyze module", [&] {return module_path.string();});
     semantic::Context context;
     context.init_with(&ast);
     context.current_module = module_path;
@@ -105,8 +112,13 @@ Result<Ok, Error> semantic::analyze_block_or_expression(semantic::Context& conte
 
     // Do type inference and semantic analysis
     // ---------------------------------------
-    auto result = semantic::type_infer_and_analyze(context, node);
-    if (result.is_error()) return Error {};
+    Result<Ok, Error> result;
+    {
+        trace::Span span("Type inference");
+        result = semantic::type_infer_and_analyze(context, node);
+        if (result.is_error()) return Error {};
+    }
+    trace::Span span("Unify");
 
     // If we are in expression add constraint for expression with function return type
     if (node->index() != ast::Block) {
@@ -167,7 +179,7 @@ Result<Ok, Error> semantic::analyze_block_or_expression(semantic::Context& conte
         }
 
         if (representatives.size() == 0) {
-            context.type_inference.labeled_type_constraints[semantic::new_final_type_variable(context)] = context.type_inference.type_constraints[i];
+            semantic::add_labeled_type_constraint(context, semantic::new_final_type_variable(context), context.type_inference.type_constraints[i]);
         }
         else {
             ast::Type representative = representatives[0];
@@ -199,12 +211,7 @@ Result<Ok, Error> semantic::analyze_block_or_expression(semantic::Context& conte
                 }
             }
 
-            if (context.type_inference.labeled_type_constraints.find(representative) == context.type_inference.labeled_type_constraints.end()) {
-                context.type_inference.labeled_type_constraints[representative] = context.type_inference.type_constraints[i];
-            }
-            else {
-                context.type_inference.labeled_type_constraints[representative].merge(context.type_inference.type_constraints[i]);
-            }
+            semantic::add_labeled_type_constraint(context, representative, context.type_inference.type_constraints[i]);
         }
     }
 
@@ -298,6 +305,8 @@ Result<Ok, Error> semantic::analyze(semantic::Context& context, ast::BlockNode&
 
 Result<Ok, Error> semantic::analyze(semantic::Context& context, ast::FunctionNode& node) {
     assert(node.module_path == context.current_module);
+    node.is_analyzed = true;
+
     if (node.is_extern
     ||  node.is_builtin) {
         for (auto arg: node.args) {
@@ -310,6 +319,7 @@ Result<Ok, Error> semantic::analyze(semantic::Context& context, ast::FunctionNod
     if (node.state == ast::FunctionBeingAnalyzed) {
         return Ok {};
     }
+    trace::Span span("Analyze function", [&] {return node.identifier->value + " (" + node.module_path.string() + ")";});
     if (node.state == ast::FunctionNotAnalyzed) {
         node.state = ast::FunctionBeingAnalyzed;
     }
@@ -393,6 +403,33 @@ Result<Ok, Error> semantic::analyze(semantic::Context& context, ast::FunctionNod
     return Ok {};
 }
 
+// Functions from modules are analyzed the first time they are referenced,
+// so importing a module only costs what is used from it
+Result<Ok, Error> semantic::analyze_on_demand(semantic::Context& context, ast::FunctionNode& function) {
+    if (function.is_analyzed || function.module_path == context.ast->module_path) return Ok {};
+
+    // Create new context for the module of the function
+    Context new_context;
+    new_context.init_with(context.ast);
+    new_context.current_module = function.module_path;
+
+    if (context.current_module == function.module_path) {
+        new_context.scopes = semantic::get_definitions(context);
+    }
+    else {
+        auto result = semantic::add_scope(new_context, *(context.ast->modules[function.module_path.string()]));
+        if (result.is_error()) {
+            context.errors.insert(context.errors.end(), new_context.errors.begin(), new_context.errors.end());
+            return result;
+        }
+    }
+
+    // Analyze function
+    auto result = semantic::analyze(new_context, function);
+    context.errors.insert(context.errors.end(), new_context.errors.begin(), new_context.errors.end());
+    return result;
+}
+
 Result<Ok, Error> semantic::analyze(semantic::Context& context, ast::Type& type) {
     if      (type.is_type_variable()) return Ok {};
     else if (type.is_final_type_variable()) return Ok {};
@@ -568,12 +605,18 @@ Result<ast::Type, Error> semantic::get_function_type(Context& context, ast::Node
 
     if (function_or_interface->index() == ast::Function) {
         function = &std::get<ast::FunctionNode>(*function_or_interface);
+
+        auto result = semantic::analyze_on_demand(context, *function);
+        if (result.is_error()) return Error {};
     }
     else if (function_or_interface->index() == ast::Interface) {
-        auto interface = std::get<ast::InterfaceNode>(*function_or_interface);
+        auto& interface = std::get<ast::InterfaceNode>(*function_or_interface);
 
         // Get function called
         for (auto it: interface.functions) {
+            auto result = semantic::analyze_on_demand(context, *it);
+            if (result.is_error()) return Error {};
+
             std::vector<ast::Type> function_types = ast::get_types(it->args);
             function_types.push_back(it->return_type);
             std::vector<ast::Type> call_types = call_args;
@@ -613,6 +656,7 @@ Result<ast::Type, Error> semantic::get_function_type(Context& context, ast::Node
                 }
 
                 // Check functions used in function
+                trace::Span span("Check functions used", [&] {return function->identifier->value.str();});
                 semantic::check_functions_used(new_context, function->body);
             }
 
@@ -623,19 +667,19 @@ Result<ast::Type, Error> semantic::get_function_type(Context& context, ast::Node
     }
     // If is generic
     else {
-        for (auto& specialization: function->specializations) {
-            if (specialization.args == call_args) {
-                if (call_type.is_concrete()) {
-                    if (specialization.return_type == call_type) {
-                        return specialization.return_type;
-                    }
-                }
-                else {
-                    return specialization.return_type;
-                }
-            }
+        auto existing_specialization = function->get_specialization(call_args, call_type);
+        if (existing_specialization) {
+            return existing_specialization->return_type;
         }
 
+        trace::Span span("Specialize function", [&] {
+            std::string detail = function->identifier->value + "(";
+            for (size_t i = 0; i < call_args.size(); i++) {
+                detail += (i == 0 ? "" : ", ") + call_args[i].to_str();
+            }
+            return detail + ")";
+        });
+
         // Add arguments to specialization
         ast::FunctionSpecialization specialization;
         for (size_t i = 0; i < function->args.size(); i++) {
@@ -652,7 +696,7 @@ Result<ast::Type, Error> semantic::get_function_type(Context& context, ast::Node
             specialization.return_type = specialization.type_bindings[specialization.return_type.as_final_type_variable().id];
         }
         assert(specialization.return_type.is_concrete());
-        function->specializations.push_back(specialization);
+        function->add_specialization(specialization);
 
         if (!function->is_builtin) {
             // Create new context to check functions used
@@ -671,6 +715,7 @@ Result<ast::Type, Error> semantic::get_function_type(Context& context, ast::Node
             }
 
             // Check functions used in function
+            trace::Span span("Check functions used", [&] {return function->identifier->value.str();});
             semantic::check_functions_used(new_context, function->body);
         }
         else if (function->identifier->value == "printStruct") {
@@ -1,5 +1,6 @@
 #include "type_infer.hpp"
 #include "semantic.hpp"
+#include "call_graph.hpp"
 #include "../semantic.hpp"
 
 Result<Ok, Error> semantic::type_infer_and_analyze(semantic::Context& context, ast::Node* node) {
@@ -22,10 +23,17 @@ Result<Ok, Error> semantic::type_infer_and_analyze(semantic::Context& context, a
         if (result.is_error()) return result;
     }
 
-    // Analyze functions of block
+    // Analyze functions of block, functions from modules are analyzed on demand
+    std::vector<ast::FunctionNode*> functions;
     for (auto function: node.functions) {
-        if (function->state == ast::FunctionAnalyzed) continue;
         if (function->module_path != context.current_module) continue;
+        if (function->module_path != context.ast->module_path) continue;
+        functions.push_back(function);
+    }
+
+    // Callees go first, so calls find them already analyzed
+    for (auto function: semantic::order_by_calls(functions)) {
+        if (function->state == ast::FunctionAnalyzed) continue;
         auto result = semantic::analyze(context, *function);
         if (result.is_error()) return result;
     }
@@ -115,7 +123,7 @@ Result<Ok, Error> semantic::type_infer_and_analyze(semantic::Context& context, a
     }
 
     // Get identifier
-    std::string identifier = node.identifier->value;
+    symbol::Symbol identifier = node.identifier->value;
 
     if (semantic::current_scope(context).variables_scope.find(identifier) != semantic::current_scope(context).variables_scope.end()
     &&  semantic::current_scope(context).variables_scope[identifier].type == VariableBinding) {
@@ -392,7 +400,7 @@ Result<Ok, Error> semantic::type_infer_and_analyze(semantic::Context& context, a
     if (!binding.has_value()) {
         std::cout << context.scopes.functions_and_types_scopes.scopes.size() << "\n";
         for (auto scope = context.scopes.functions_and_types_scopes.scopes.rbegin(); scope != context.scopes.functions_and_types_scopes.scopes.rend(); scope++) {
-            for (auto it: *scope) {
+            for (auto it: **scope) {
                 std::cout << "   " << it.first << "\n";
             }
         }
@@ -420,6 +428,9 @@ Result<Ok, Error> semantic::type_infer_and_analyze(semantic::Context& context, a
         }
         else if (binding.value().type == semantic::FunctionBinding) {
             auto function = semantic::get_function(*binding);
+            auto result = semantic::analyze_on_demand(context, *function);
+            if (result.is_error()) return result;
+
             if (function->state == ast::FunctionNotAnalyzed) {
                 if (function->module_path == context.current_module) {
                     auto result = semantic::analyze(context, *function);
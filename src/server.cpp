@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "server.hpp"
+#include "codegen.hpp"
+#include "errors.hpp"
+#include "semantic.hpp"
+
+#ifndef _WIN32
+// Requests
+// --------
+// A request is the working directory and the arguments, each one ending
+// with a null character, preceded by their size. The standard input,
+// output and error of the client are sent along with the size. The
+// response is the exit status.
+#ifdef MSG_NOSIGNAL
+static const int send_flags = MSG_NOSIGNAL; // A client or server that went away is not a reason to die
+#else
+static const int send_flags = 0;
+#endif
+
+static bool send_all(int fd, const void* data, size_t size) {
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t result = send(fd, (const char*) data + sent, size - sent, send_flags);
+        if (result == -1 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        sent += (size_t) result;
+    }
+    return true;
+}
+
+static bool receive_all(int fd, void* data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t result = recv(fd, (char*) data + received, size - received, 0);
+        if (result == -1 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        received += (size_t) result;
+    }
+    return true;
+}
+
+static bool send_request(int fd, const std::string& payload) {
+    uint32_t size = payload.size();
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+
+    iovec data;
+    data.iov_base = &size;
+    data.iov_len = sizeof(size);
+
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    if (sendmsg(fd, &message, send_flags) != sizeof(size)) return false;
+    return send_all(fd, payload.data(), payload.size());
+}
+
+// Requests are read as they arrive, so a slow client doesn't hold up the
+// others. Returns false if the connection should be closed.
+struct Connection {
+    int fd;
+    int fds[3] = {-1, -1, -1}; // Standard streams of the client
+    std::string buffer;
+    std::chrono::steady_clock::time_point deadline;
+    pid_t pid = 0; // Process running the request, 0 while it's being received
+
+    bool has_fds() {return this->fds[0] != -1;}
+    bool is_complete();
+    std::vector<std::string> get_strings();
+    void close_fds();
+};
+
+static const uint32_t max_request_size = 1 << 20;
+
+static bool receive_request(Connection& connection) {
+    while (true) {
+        char data[4096];
+        iovec vector;
+        vector.iov_base = data;
+        vector.iov_len = sizeof(data);
+
+        char control[CMSG_SPACE(3 * sizeof(int))];
+        memset(control, 0, sizeof(control));
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = recvmsg(connection.fd, &message, 0);
+        if (received == -1 && errno == EINTR) continue;
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (received <= 0) return false;
+
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+
+            int fds[3];
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(header), std::min(count, (size_t) 3) * sizeof(int));
+            if (count != 3 || connection.has_fds()) {
+                for (size_t i = 0; i < std::min(count, (size_t) 3); i++) close(fds[i]);
+                return false;
+            }
+            memcpy(connection.fds, fds, sizeof(fds));
+        }
+        if (message.msg_flags & MSG_CTRUNC) return false;
+
+        connection.buffer.append(data, received);
+        if (connection.buffer.size() >= sizeof(uint32_t)) {
+            uint32_t size;
+            memcpy(&size, connection.buffer.data(), sizeof(size));
+            if (size > max_request_size || connection.buffer.size() > sizeof(size) + size) return false;
+        }
+    }
+}
+
+bool Connection::is_complete() {
+    if (!this->has_fds() || this->buffer.size() < sizeof(uint32_t)) return false;
+
+    uint32_t size;
+    memcpy(&size, this->buffer.data(), sizeof(size));
+    return this->buffer.size() == sizeof(size) + size;
+}
+
+std::vector<std::string> Connection::get_strings() {
+    std::vector<std::string> strings;
+    size_t start = sizeof(uint32_t);
+    for (size_t i = start; i < this->buffer.size(); i++) {
+        if (this->buffer[i] == '\0') {
+            strings.push_back(this->buffer.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    return strings;
+}
+
+void Connection::close_fds() {
+    for (size_t i = 0; i < 3; i++) {
+        if (this->fds[i] != -1) close(this->fds[i]);
+        this->fds[i] = -1;
+    }
+}
+
+// Only the user running the server can send it requests, they run code
+static bool is_from_same_user(int fd) {
+#ifdef SO_PEERCRED
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) return false;
+    return credentials.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) return false;
+    return uid == getuid();
+#endif
+}
+
+static bool make_address(std::filesystem::path socket_path, sockaddr_un& address) {
+    std::string path = socket_path.string();
+    memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path)) return false;
+
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Server
+// ------
+// Every request runs in a fork of the server. The server sends the exit
+// status to the client when the fork ends, it finds out through a pipe
+// written by the SIGCHLD handler.
+static int wake_up_pipe[2];
+
+static void on_child_exit(int) {
+    int saved_errno = errno;
+    (void) write(wake_up_pipe[1], "", 1);
+    errno = saved_errno;
+}
+
+static int32_t get_exit_status(int wait_status) {
+    if (WIFEXITED(wait_status))   return WEXITSTATUS(wait_status);
+    if (WIFSIGNALED(wait_status)) return 128 + WTERMSIG(wait_status);
+    return EXIT_FAILURE;
+}
+
+static void run_request(int fds[3], std::vector<std::string>& strings, server::Handler handler) {
+    // Run the request as if the client had done it
+    dup2(fds[0], STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[2], STDERR_FILENO);
+    for (size_t i = 0; i < 3; i++) {
+        if (fds[i] > STDERR_FILENO) close(fds[i]);
+    }
+    if (chdir(strings[0].c_str()) != 0) _exit(EXIT_FAILURE);
+
+    std::vector<char*> argv;
+    for (size_t i = 1; i < strings.size(); i++) {
+        argv.push_back(&strings[i][0]);
+    }
+    argv.push_back(nullptr);
+    exit(handler(argv.size() - 1, argv.data()));
+}
+
+// Each request runs in its own process group, so everything it started
+// (like the program of diamond run) can be stopped when its client goes away
+static void start_request(Connection& connection, std::vector<Connection>& connections, int listener, server::Handler handler) {
+    auto strings = connection.get_strings();
+    if (strings.size() < 2) {
+        connection.pid = -1;
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        signal(SIGCHLD, SIG_DFL);
+        close(listener);
+        close(wake_up_pipe[0]);
+        close(wake_up_pipe[1]);
+        for (auto& other: connections) {
+            if (other.fd != -1) close(other.fd);
+            if (&other != &connection) other.close_fds();
+        }
+        run_request(connection.fds, strings, handler);
+    }
+    if (pid != -1) setpgid(pid, pid);
+
+    connection.close_fds();
+    connection.buffer = {};
+    connection.pid = pid;
+}
+
+static void stop_request(Connection& connection) {
+    kill(-connection.pid, SIGTERM);
+    close(connection.fd);
+    connection.fd = -1;
+}
+
+void server::serve(std::filesystem::path socket_path, server::Handler handler) {
+    // Everything done here is shared by the requests
+    codegen::initialize_targets();
+    semantic::load_prelude();
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        std::cout << errors::server_couldnt_start(socket_path, "The path of the socket is too long.");
+        exit(EXIT_FAILURE);
+    }
+
+    // Remove the socket left by a previous server
+    std::error_code error;
+    if (std::filesystem::is_socket(socket_path, error)) {
+        std::filesystem::remove(socket_path, error);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1
+    ||  bind(listener, (sockaddr*) &address, sizeof(address)) != 0
+    ||  chmod(address.sun_path, S_IRUSR | S_IWUSR) != 0
+    ||  listen(listener, SOMAXCONN) != 0
+    ||  pipe(wake_up_pipe) != 0) {
+        std::cout << errors::server_couldnt_start(socket_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    fcntl(wake_up_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_up_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_child_exit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+
+    // Connections being received, and the ones whose request is running.
+    // A running request whose connection was closed (fd is -1) is waited
+    // for but has no one to tell how it ended.
+    std::vector<Connection> connections;
+    while (true) {
+        // A client that doesn't send its request can't keep a connection open
+        auto now = std::chrono::steady_clock::now();
+        int timeout = -1;
+        for (auto& connection: connections) {
+            if (connection.pid != 0 || connection.fd == -1) continue;
+            if (connection.deadline <= now) {
+                close(connection.fd);
+                connection.fd = -1;
+                connection.close_fds();
+                continue;
+            }
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(connection.deadline - now).count() + 1;
+            if (timeout == -1 || remaining < timeout) timeout = (int) remaining;
+        }
+        connections.erase(std::remove_if(connections.begin(), connections.end(), [](Connection& connection) {
+            return connection.fd == -1 && connection.pid <= 0;
+        }), connections.end());
+
+        std::vector<pollfd> fds = {{listener, POLLIN, 0}, {wake_up_pipe[0], POLLIN, 0}};
+        for (auto& connection: connections) {
+            fds.push_back({connection.fd, POLLIN, 0}); // Ignored by poll if it's -1
+        }
+        if (poll(fds.data(), fds.size(), timeout) == -1) {
+            if (errno == EINTR) continue;
+            std::cout << errors::server_couldnt_start(socket_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        // Tell clients how their requests ended
+        if (fds[1].revents & POLLIN) {
+            char buffer[64];
+            while (read(wake_up_pipe[0], buffer, sizeof(buffer)) > 0) {}
+
+            int wait_status = 0;
+            pid_t pid;
+            while ((pid = waitpid(-1, &wait_status, WNOHANG)) > 0) {
+                for (auto& connection: connections) {
+                    if (connection.pid != pid) continue;
+
+                    if (connection.fd != -1) {
+                        int32_t status = get_exit_status(wait_status);
+                        send_all(connection.fd, &status, sizeof(status));
+                        close(connection.fd);
+                        connection.fd = -1;
+                    }
+                    connection.pid = -1;
+                }
+            }
+        }
+
+        // Receive requests, and stop the ones whose client went away. A
+        // client doesn't send anything after its request, so the connection
+        // being readable means it was closed.
+        size_t size = connections.size();
+        for (size_t i = 0; i < size; i++) {
+            auto& connection = connections[i];
+            if (connection.fd == -1 || fds[i + 2].revents == 0) continue;
+
+            if (connection.pid > 0) {
+                stop_request(connection);
+            }
+            else if (connection.pid == 0) {
+                if (!receive_request(connection)) {
+                    close(connection.fd);
+                    connection.fd = -1;
+                    connection.close_fds();
+                }
+                else if (connection.is_complete()) {
+                    start_request(connection, connections, listener, handler);
+                }
+            }
+
+            if (connection.pid == -1 && connection.fd != -1) {
+                int32_t status = EXIT_FAILURE;
+                send_all(connection.fd, &status, sizeof(status));
+                close(connection.fd);
+                connection.fd = -1;
+            }
+        }
+
+        // Accept new clients
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listener, nullptr, nullptr)) != -1) {
+                if (!is_from_same_user(fd)) {
+                    close(fd);
+                    continue;
+                }
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+
+                Connection connection;
+                connection.fd = fd;
+                connection.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                connections.push_back(std::move(connection));
+            }
+        }
+    }
+}
+
+// Client
+// ------
+std::optional<int> server::forward(int argc, char* argv[]) {
+    const char* socket_path = getenv("DIAMOND_SERVER");
+    if (!socket_path || socket_path[0] == '\0') return std::nullopt;
+
+    sockaddr_un address;
+    if (!make_address(socket_path, address)) return std::nullopt;
+
+    std::error_code error;
+    auto current_path = std::filesystem::current_path(error);
+    if (error) return std::nullopt;
+
+    // Compile without the server if it isn't running
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return std::nullopt;
+    if (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::string payload = current_path.string() + '\0';
+    for (int i = 0; i < argc; i++) {
+        payload += argv[i];
+        payload += '\0';
+    }
+    if (!send_request(fd, payload)) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    int32_t status = EXIT_FAILURE;
+    if (!receive_all(fd, &status, sizeof(status))) status = EXIT_FAILURE;
+    close(fd);
+    return status;
+}
+
+#else
+void server::serve(std::filesystem::path socket_path, server::Handler handler) {
+    std::cout << errors::server_couldnt_start(socket_path, "The server is not available on Windows.");
+    exit(EXIT_FAILURE);
+}
+
+std::optional<int> server::forward(int argc, char* argv[]) {
+    return std::nullopt;
+}
+#endif
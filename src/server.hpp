@@ -0,0 +1,21 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <filesystem>
+#include <optional>
+
+namespace server {
+    // diamond server keeps a process with the llvm targets initialized and
+    // std analyzed, and forks it for every request, so requests don't pay
+    // for starting the compiler. When DIAMOND_SERVER has the path of the
+    // server socket, diamond sends its arguments, working directory and
+    // standard streams to the server and exits with the status of the
+    // request. Only the user running the server can send it requests, and
+    // a request is stopped when its client goes away. Not available on
+    // Windows.
+    using Handler = int (*)(int argc, char* argv[]);
+    void serve(std::filesystem::path socket_path, Handler handler); // Doesn't return
+    std::optional<int> forward(int argc, char* argv[]); // Returns nullopt if there is no server
+}
+
+#endif
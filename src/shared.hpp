@@ -1,6 +1,7 @@
 #ifndef SHARED_HPP
 #define SHARED_HPP
 
+#include <cstdint>
 #include <vector>
 #include <cassert>
 #include <variant>
@@ -22,8 +23,8 @@ struct Result {
     std::variant<T1, T2> value;
 
     Result() {}
-    Result(T1 value) : value(value) {}
-    Result(T2 error) : value(error) {}
+    Result(T1 value) : value(std::move(value)) {}
+    Result(T2 error) : value(std::move(error)) {}
     ~Result() {}
 
     bool is_ok()    {return std::holds_alternative<T1>(this->value);}
@@ -43,11 +44,11 @@ struct Result {
 };
 
 struct Location {
-    size_t line;
-    size_t column;
+    uint32_t line;
+    uint32_t column;
     std::filesystem::path file;
 
-    Location(size_t line, size_t column, std::filesystem::path file) : line(line), column(column), file(file) {}
+    Location(uint32_t line, uint32_t column, std::filesystem::path file) : line(line), column(column), file(file) {}
 };
 
 #endif
@@ -0,0 +1,73 @@
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+#include "symbols.hpp"
+
+// Interning table
+// ---------------
+// Strings are stored in fixed size chunks that never move, so a symbol can
+// be turned back into its string without taking the lock. Only interning
+// new strings is serialized.
+namespace symbol {
+    const uint32_t chunk_bits = 12;
+    const uint32_t chunk_size = 1 << chunk_bits;
+    const uint32_t max_chunks = 1 << 12;
+
+    struct Table {
+        std::mutex mutex;
+        std::atomic<std::string*> chunks[max_chunks] = {};
+        uint32_t size = 0;
+        std::unordered_map<std::string_view, uint32_t> ids;
+
+        Table() {
+            this->insert(std::string_view()); // Symbol 0 is the empty string
+        }
+
+        uint32_t insert(std::string_view str) {
+            uint32_t id = this->size;
+            uint32_t chunk = id >> chunk_bits;
+            assert(chunk < max_chunks);
+
+            std::string* strings = this->chunks[chunk].load(std::memory_order_relaxed);
+            if (strings == nullptr) {
+                strings = new std::string[chunk_size];
+                this->chunks[chunk].store(strings, std::memory_order_release);
+            }
+
+            strings[id & (chunk_size - 1)] = std::string(str);
+            this->ids[std::string_view(strings[id & (chunk_size - 1)])] = id;
+            this->size++;
+            return id;
+        }
+    };
+
+    static Table& table() {
+        static Table table;
+        return table;
+    }
+};
+
+symbol::Symbol symbol::intern(std::string_view str) {
+    Table& table = symbol::table();
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    Symbol symbol;
+    auto it = table.ids.find(str);
+    if (it != table.ids.end()) symbol.id = it->second;
+    else                       symbol.id = table.insert(str);
+    return symbol;
+}
+
+// Symbol
+// ------
+symbol::Symbol::Symbol(const char* str) : Symbol(std::string_view(str)) {}
+symbol::Symbol::Symbol(const std::string& str) : Symbol(std::string_view(str)) {}
+symbol::Symbol::Symbol(std::string_view str) : id(symbol::intern(str).id) {}
+
+const std::string& symbol::Symbol::str() const {
+    std::string* strings = symbol::table().chunks[this->id >> chunk_bits].load(std::memory_order_acquire);
+    return strings[this->id & (chunk_size - 1)];
+}
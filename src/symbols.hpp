@@ -0,0 +1,52 @@
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+
+namespace symbol {
+    // Identifiers are interned in a process wide table, so a symbol is just
+    // an index into it. Comparing and hashing symbols doesn't touch the text.
+    struct Symbol {
+        uint32_t id = 0; // 0 is always the empty string
+
+        Symbol() {}
+        Symbol(const char* str);
+        Symbol(std::string_view str);
+        Symbol(const std::string& str);
+
+        const std::string& str() const;
+        operator const std::string&() const {return this->str();}
+
+        bool operator==(const Symbol& other) const {return this->id == other.id;}
+        bool operator!=(const Symbol& other) const {return this->id != other.id;}
+        bool operator==(const char* other) const {return this->str() == other;}
+        bool operator!=(const char* other) const {return this->str() != other;}
+        bool operator==(const std::string& other) const {return this->str() == other;}
+        bool operator!=(const std::string& other) const {return this->str() != other;}
+    };
+
+    Symbol intern(std::string_view str);
+};
+
+inline bool operator==(const std::string& lhs, const symbol::Symbol& rhs) {return rhs == lhs;}
+inline bool operator!=(const std::string& lhs, const symbol::Symbol& rhs) {return rhs != lhs;}
+inline std::string operator+(const std::string& lhs, const symbol::Symbol& rhs) {return lhs + rhs.str();}
+inline std::string operator+(const symbol::Symbol& lhs, const std::string& rhs) {return lhs.str() + rhs;}
+inline std::string operator+(const char* lhs, const symbol::Symbol& rhs) {return lhs + rhs.str();}
+inline std::string operator+(const symbol::Symbol& lhs, const char* rhs) {return lhs.str() + rhs;}
+inline std::ostream& operator<<(std::ostream& stream, const symbol::Symbol& symbol) {return stream << symbol.str();}
+
+namespace std {
+    template <>
+    struct hash<symbol::Symbol> {
+        size_t operator()(const symbol::Symbol& symbol) const {
+            return symbol.id;
+        }
+    };
+}
+
+#endif
@@ -3,7 +3,39 @@
 
 #include "tokens.hpp"
 
-void token::print(std::vector<Token> token) {
+std::string_view token::Tokens::get_text(const Token& token) const {
+    return std::string_view(this->source.data() + token.offset, token.length);
+}
+
+std::string token::Tokens::get_literal(const Token& token) const {
+    std::string_view text = this->get_text(token);
+
+    switch (token.variant) {
+        case String:
+        case StringLeft:
+        case StringMiddle:
+        case StringRight: {
+            // Process escape sequences
+            std::string literal;
+            literal.reserve(text.size());
+            for (size_t i = 0; i < text.size(); i++) {
+                if (text[i] == '\\' && i + 1 < text.size()) {
+                    switch (text[i + 1]) {
+                        case 'n':  literal += '\n'; i++; continue;
+                        case '"':  literal += '"'; i++; continue;
+                        case '{':  literal += '{'; i++; continue;
+                        default: break;
+                    }
+                }
+                literal += text[i];
+            }
+            return literal;
+        }
+        default: return std::string(text);
+    }
+}
+
+void token::print(const Tokens& token) {
     for (size_t i = 0; i < token.size(); i++) {
         switch (token[i].variant) {
             case LeftParen: {
@@ -107,31 +139,31 @@ void token::print(std::vector<Token> token) {
                 break;
             }
             case Integer: {
-                std::cout << "token::Integer(" << token[i].get_literal() << ")";
+                std::cout << "token::Integer(" << token.get_literal(token[i]) << ")";
                 break;
             }
             case Float: {
-                std::cout << "token::Float(" << token[i].get_literal() << ")";
+                std::cout << "token::Float(" << token.get_literal(token[i]) << ")";
                 break;
             }
             case Identifier: {
-                std::cout << "token::Identifier(" << token[i].get_literal() << ")";
+                std::cout << "token::Identifier(" << token.get_literal(token[i]) << ")";
                 break;
             }
             case String: {
-                std::cout << "token::String(\"" << token[i].get_literal() << "\")";
+                std::cout << "token::String(\"" << token.get_literal(token[i]) << "\")";
                 break;
             }
             case StringLeft: {
-                std::cout << "token::StringLeft(\"" << token[i].get_literal() << "\")";
+                std::cout << "token::StringLeft(\"" << token.get_literal(token[i]) << "\")";
                 break;
             }
             case StringMiddle: {
-                std::cout << "token::StringMiddle(\"" << token[i].get_literal() << "\")";
+                std::cout << "token::StringMiddle(\"" << token.get_literal(token[i]) << "\")";
                 break;
             }
             case StringRight: {
-                std::cout << "token::StringRight(\"" << token[i].get_literal() << "\")";
+                std::cout << "token::StringRight(\"" << token.get_literal(token[i]) << "\")";
                 break;
             }
             case If: {
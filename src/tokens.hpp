@@ -2,11 +2,13 @@
 #define TOKENS_HPP
 
 #include <string>
+#include <string_view>
 #include <cstring>
+#include <cstdint>
 #include <vector>
 
 namespace token {
-    enum TokenVariant {
+    enum TokenVariant : uint8_t {
         LeftParen,
         RightParen,
         LeftBracket,
@@ -64,23 +66,17 @@ namespace token {
         EndOfFile
     };
 
+    // Tokens don't own their text, they point into the source buffer
+    // kept by Tokens. This keeps them small and cheap to copy.
     struct Token {
-        token::TokenVariant variant;
-        std::string str;
-        const char* static_str = nullptr;
-        size_t line;
-        size_t column;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        uint32_t line = 0;
+        uint32_t column = 0;
+        token::TokenVariant variant = token::EndOfFile;
 
         Token() {}
-        Token(token::TokenVariant variant, size_t line, size_t column) : variant(variant), line(line), column(column) {}
-        Token(token::TokenVariant variant, std::string literal, size_t line, size_t column) : variant(variant), str(literal), line(line), column(column) {}
-        Token(token::TokenVariant variant, const char* literal, size_t line, size_t column) : variant(variant), static_str(literal), line(line), column(column) {}
-        ~Token() {}
-
-        std::string get_literal() {
-            if (static_str) return std::string(this->static_str);
-            else            return this->str;
-        }
+        Token(token::TokenVariant variant, size_t offset, size_t length, size_t line, size_t column) : offset(offset), length(length), line(line), column(column), variant(variant) {}
 
         bool operator==(const TokenVariant variant) const {
             return this->variant == variant;
@@ -90,7 +86,20 @@ namespace token {
         }
     };
 
-    void print(std::vector<Token> tokens);
+    struct Tokens {
+        std::string source;
+        std::vector<Token> tokens;
+
+        Tokens() {}
+        Tokens(std::string source) : source(std::move(source)) {}
+
+        size_t size() const {return this->tokens.size();}
+        const Token& operator[](size_t index) const {return this->tokens[index];}
+        std::string_view get_text(const Token& token) const;
+        std::string get_literal(const Token& token) const;
+    };
+
+    void print(const Tokens& tokens);
 };
 
 #endif
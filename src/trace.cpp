@@ -0,0 +1,155 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "trace.hpp"
+
+// Events
+// ------
+struct Event {
+    const char* name;
+    std::string detail;
+    size_t thread;
+    int64_t start;
+    int64_t duration; // Negative for counters
+    double value;
+};
+
+static std::atomic<bool> enabled = false;
+static std::mutex mutex;
+static std::vector<Event> events;
+static std::filesystem::path trace_path;
+static std::chrono::steady_clock::time_point start_time;
+
+// Microseconds since the trace started
+static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Threads are numbered in the order they record their first event
+static size_t get_thread() {
+    static std::atomic<size_t> next_thread = 0;
+    thread_local size_t thread = next_thread++;
+    return thread;
+}
+
+static void add_event(Event event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+}
+
+// Peak memory
+// -----------
+static double get_peak_memory_in_megabytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0); // In bytes
+#else
+    return usage.ru_maxrss / 1024.0; // In kilobytes
+#endif
+#endif
+}
+
+void trace::record_peak_memory() {
+    if (!enabled) return;
+    add_event(Event {"Peak RSS", "", get_thread(), now(), -1, get_peak_memory_in_megabytes()});
+}
+
+// Spans
+// -----
+trace::Span::Span(const char* name) : name(name), is_enabled(enabled), start(0) {
+    if (this->is_enabled) this->start = now();
+}
+
+void trace::Span::begin(std::string detail) {
+    this->detail = std::move(detail);
+    this->start = now();
+}
+
+trace::Span::~Span() {
+    if (!this->is_enabled || !enabled) return;
+    add_event(Event {this->name, std::move(this->detail), get_thread(), this->start, now() - this->start, 0});
+}
+
+// Writing
+// -------
+static std::string escape(const std::string& str) {
+    std::string result;
+    for (char c: str) {
+        if      (c == '"')  result += "\\\"";
+        else if (c == '\\') result += "\\\\";
+        else if ((unsigned char) c < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            result += buffer;
+        }
+        else result += c;
+    }
+    return result;
+}
+
+static void write_trace() {
+    trace::finish();
+}
+
+void trace::start(std::filesystem::path path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    trace_path = path;
+    if (enabled) return;
+
+    start_time = std::chrono::steady_clock::now();
+    enabled = true;
+    std::atexit(write_trace);
+}
+
+bool trace::is_enabled() {
+    return enabled;
+}
+
+void trace::finish() {
+    trace::record_peak_memory();
+    if (!enabled.exchange(false)) return;
+
+#ifdef _WIN32
+    int pid = (int) GetCurrentProcessId();
+#else
+    int pid = (int) getpid();
+#endif
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream file(trace_path, std::ios::binary);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (size_t i = 0; i < events.size(); i++) {
+        auto& event = events[i];
+        file << "{\"name\": \"" << event.name << "\", \"pid\": " << pid << ", \"tid\": " << event.thread << ", \"ts\": " << event.start;
+        if (event.duration < 0) {
+            file << ", \"ph\": \"C\", \"args\": {\"MB\": " << event.value << "}}";
+        }
+        else {
+            file << ", \"ph\": \"X\", \"dur\": " << event.duration;
+            if (event.detail.size() > 0) file << ", \"args\": {\"detail\": \"" << escape(event.detail) << "\"}";
+            file << "}";
+        }
+        file << (i + 1 == events.size() ? "\n" : ",\n");
+    }
+    file << "]}\n";
+    events = {};
+}
@@ -0,0 +1,44 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace trace {
+    // With --time-trace the time spent on each phase, module, function and
+    // specialization is recorded, along with the peak memory used, and
+    // written as a Chrome trace when the process ends. It can be opened in
+    // https://ui.perfetto.dev or chrome://tracing. When it's not enabled
+    // spans cost a check of a flag.
+    void start(std::filesystem::path path); // Calling it again only changes the path
+    bool is_enabled();
+    void finish(); // Writes the trace, for when the process doesn't end with exit
+    void record_peak_memory();
+
+    // Measures the time from its creation to the end of its scope. The
+    // detail, like the name of a function, is given as a callable returning
+    // a string. It's only called when tracing, otherwise the span doesn't
+    // build or allocate anything.
+    struct Span {
+        const char* name;
+        std::string detail;
+        bool is_enabled;
+        int64_t start;
+
+        Span(const char* name);
+        template <typename GetDetail>
+        Span(const char* name, const GetDetail& get_detail) : name(name), is_enabled(trace::is_enabled()), start(0) {
+            if (this->is_enabled) this->begin(get_detail());
+        }
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        void begin(std::string detail);
+    };
+}
+
+#endif
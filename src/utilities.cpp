@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <cstdlib>
+#include <vector>
 
 #include "utilities.hpp"
 #include "errors.hpp"
@@ -50,7 +53,7 @@ std::string utilities::to_str(Set<ast::Type> set) {
 }
 
 #ifdef __linux__
-std::filesystem::path get_executable_path() {
+std::filesystem::path utilities::get_executable_path() {
     return std::filesystem::canonical("/proc/self/exe");
 }
 
@@ -65,7 +68,7 @@ std::string utilities::get_run_command(std::string program_name) {
 #elif __APPLE__
 #include <mach-o/dyld.h>
 
-std::filesystem::path get_executable_path() {
+std::filesystem::path utilities::get_executable_path() {
     // Get size of path
     uint32_t size = 0;
     _NSGetExecutablePath(NULL, &size);
@@ -90,7 +93,7 @@ std::string utilities::get_run_command(std::string program_name) {
 #elif _WIN32
 #include <Windows.h>
 
-std::filesystem::path get_executable_path() {
+std::filesystem::path utilities::get_executable_path() {
     std::string path;
     while (true) {
         path.resize(path.size() + MAX_PATH);
@@ -110,5 +113,91 @@ std::string utilities::get_run_command(std::string program_name) {
 #endif
 
 std::filesystem::path utilities::get_folder_of_executable() {
-    return get_executable_path().parent_path();
-}
\ No newline at end of file
+    return utilities::get_executable_path().parent_path();
+}
+// Directory shared by the compiler caches, it can be changed with
+// DIAMOND_CACHE_DIR. Returns nullopt if there is no suitable place.
+std::optional<std::filesystem::path> utilities::get_cache_directory() {
+    if (const char* path = std::getenv("DIAMOND_CACHE_DIR")) {
+        if (path[0] != '\0') return std::filesystem::path(path);
+    }
+#ifdef _WIN32
+    if (const char* path = std::getenv("LOCALAPPDATA")) {
+        if (path[0] != '\0') return std::filesystem::path(path) / "diamond";
+    }
+#else
+    if (const char* path = std::getenv("XDG_CACHE_HOME")) {
+        if (path[0] != '\0') return std::filesystem::path(path) / "diamond";
+    }
+    if (const char* path = std::getenv("HOME")) {
+        if (path[0] != '\0') return std::filesystem::path(path) / ".cache" / "diamond";
+    }
+#endif
+    return std::nullopt;
+}
+
+void utilities::mark_as_used(std::filesystem::path file) {
+    std::error_code error;
+    std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+}
+
+// The newest file is always kept, it's the one that was just saved
+void utilities::trim_cache_directory(std::filesystem::path directory, uintmax_t max_size) {
+    struct CachedFile {
+        std::filesystem::path path;
+        std::filesystem::file_time_type last_used;
+        uintmax_t size;
+    };
+
+    std::error_code error;
+    std::vector<CachedFile> files;
+    uintmax_t size = 0;
+    for (auto it = std::filesystem::directory_iterator(directory, error); !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+        std::error_code file_error;
+        if (!it->is_regular_file(file_error)) continue;
+
+        CachedFile file {it->path(), it->last_write_time(file_error), 0};
+        if (file_error) continue;
+        file.size = it->file_size(file_error);
+        if (file_error) continue;
+
+        files.push_back(file);
+        size += file.size;
+    }
+    if (size <= max_size) return;
+
+    std::sort(files.begin(), files.end(), [](auto& a, auto& b) {return a.last_used < b.last_used;});
+    for (size_t i = 0; i + 1 < files.size() && size > max_size; i++) {
+        if (std::filesystem::remove(files[i].path, error)) size -= files[i].size;
+    }
+}
+
+// Hashing
+// -------
+uint64_t utilities::hash_bytes(const void* bytes, size_t size, uint64_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        seed ^= ((const unsigned char*) bytes)[i];
+        seed *= 1099511628211ull;
+    }
+    return seed;
+}
+
+uint64_t utilities::hash_string(const std::string& string, uint64_t seed) {
+    return utilities::hash_bytes(string.data(), string.size(), utilities::hash_bytes(&seed, sizeof(seed), 14695981039346656037ull));
+}
+
+uint64_t utilities::hash_value(uint64_t value, uint64_t seed) {
+    return utilities::hash_bytes(&value, sizeof(value), seed);
+}
+
+uint64_t utilities::get_compiler_version() {
+    static uint64_t version = [] {
+        std::error_code error;
+        auto executable = utilities::get_executable_path();
+        uint64_t version = 14695981039346656037ull;
+        version = utilities::hash_value(std::filesystem::file_size(executable, error), version);
+        version = utilities::hash_value(std::filesystem::last_write_time(executable, error).time_since_epoch().count(), version);
+        return version;
+    }();
+    return version;
+}
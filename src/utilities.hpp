@@ -1,8 +1,10 @@
 #ifndef UTILITIES_HPP
 #define UTILITIES_HPP
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <optional>
 
 #include "shared.hpp"
 #include "errors.hpp"
@@ -15,7 +17,20 @@ namespace utilities {
     std::string get_run_command(std::string path);
     std::string to_str(Set<ast::Type> set);
     std::string get_program_name();
+    std::filesystem::path get_executable_path();
     std::filesystem::path get_folder_of_executable();
+    std::optional<std::filesystem::path> get_cache_directory();
+
+    // Cache directories are kept under a size by removing the files used
+    // the longest time ago, using a file updates its modification time
+    void mark_as_used(std::filesystem::path file);
+    void trim_cache_directory(std::filesystem::path directory, uintmax_t max_size);
+
+    // Hashing (FNV-1a)
+    uint64_t hash_bytes(const void* bytes, size_t size, uint64_t seed);
+    uint64_t hash_string(const std::string& string, uint64_t seed);
+    uint64_t hash_value(uint64_t value, uint64_t seed);
+    uint64_t get_compiler_version(); // Changes every time the compiler binary changes
 }
 
 #endif
@@ -6,6 +6,9 @@ import subprocess
 import multiprocessing
 import functools
 import platform
+import tempfile
+import shutil
+import time
 
 def get_name():
     if   platform.system() == 'Linux': return 'diamond'
@@ -42,9 +45,9 @@ def get_all_files(folder):
 
     return files
 
-def test(file, expected, max_file_path_len):
+def test(file, expected, max_file_path_len, run_options=[]):
     # Run program and check output
-    result = subprocess.run([get_command(), 'run', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1))
+    result = subprocess.run([get_command(), 'run'] + run_options + [file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1))
     result = result.stdout
     result = re.sub("\\x1b\\[.+?m", "", result) # Remove escape sequences for colored text
     result = result == expected
@@ -57,13 +60,123 @@ def test(file, expected, max_file_path_len):
     # Return result
     return result
 
-def read_file_and_test(file, max_file_path_len):
+def test_cache(file, max_file_path_len):
+    # Emit llvm ir with an empty module cache and again using it
+    with tempfile.TemporaryDirectory() as cache_directory:
+        environment = dict(os.environ, DIAMOND_CACHE_DIR=cache_directory)
+        cold = subprocess.run([get_command(), 'emit', '--llvm-ir', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1), env=environment)
+        warm = subprocess.run([get_command(), 'emit', '--llvm-ir', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1), env=environment)
+        result = cold.returncode == warm.returncode and cold.stdout == warm.stdout
+
+    # Print result
+    status = '\u001b[32mOK\u001b[0m' if result == True else '\u001b[31mFailed\u001b[0m'
+    spacing = " " * (max_file_path_len - len(file) + 1)
+    print(f"{file}{spacing}{status}", flush=True)
+
+    # Return result
+    return result
+
+def test_native_target(file, max_file_path_len):
+    # Running with --target-cpu=native and with the cpu and features of this
+    # machine given explicitly must use the same cached executable, the
+    # cache is keyed by the cpu the code is for and not by "native"
+    target = subprocess.run([get_command(), 'emit', '--target', '--target-cpu=native', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1))
+    triple, cpu, features = target.stdout.split('\n')[0:3]
+
+    with tempfile.TemporaryDirectory() as cache_directory:
+        environment = dict(os.environ, DIAMOND_CACHE_DIR=cache_directory)
+        native = subprocess.run([get_command(), 'run', '--target-cpu=native', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1), env=environment)
+        explicit = subprocess.run([get_command(), 'run', '--target-cpu=' + cpu, '--target-features=' + features, file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1), env=environment)
+        executables = os.listdir(os.path.join(cache_directory, 'executables'))
+        result = target.returncode == 0 and native.stdout == explicit.stdout and len(executables) == 1
+
+    # Print result
+    name = file + ' (native target)'
+    status = '\u001b[32mOK\u001b[0m' if result == True else '\u001b[31mFailed\u001b[0m'
+    spacing = " " * (max_file_path_len - len(name) + 1)
+    print(f"{name}{spacing}{status}", flush=True)
+
+    # Return result
+    return result
+
+def test_batch(max_file_path_len):
+    # Build two programs, one using modules, and one that doesn't compile
+    # with --batch, the others must still be built and run
+    name = 'build --batch'
+    with tempfile.TemporaryDirectory() as directory:
+        shutil.copy(os.path.join('test', 'functions', 'functions1.dmd'), directory)
+        shutil.copy(os.path.join('test', 'modules', 'modules4.dmd'), directory)
+        os.mkdir(os.path.join(directory, 'modules'))
+        for module in ['identity.dmd', 'twice.dmd']:
+            shutil.copy(os.path.join('test', 'modules', 'modules', module), os.path.join(directory, 'modules'))
+        with open(os.path.join(directory, 'broken.dmd'), 'w', encoding=os.device_encoding(1)) as broken:
+            broken.write("print(undefined_variable)\n")
+
+        batch = subprocess.run([get_command(), 'build', '--batch', directory], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1))
+        output = re.sub("\\x1b\\[.+?m", "", batch.stdout)
+        result = batch.returncode != 0 and "Built 2 of 3 programs" in output
+        result = result and ("FAILED " + os.path.join(directory, 'broken.dmd')) in output
+
+        for program in ['functions1', 'modules4']:
+            path = os.path.join(directory, program)
+            with open(path + '.dmd', encoding=os.device_encoding(1)) as content:
+                expected = re.search("(?<=--- Output\n)(.|\n)*(?=---)", content.read()).group(0)
+            if platform.system() == 'Windows': path += '.exe'
+            if not os.path.exists(path):
+                result = False
+                continue
+            run = subprocess.run([path], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1))
+            result = result and run.stdout == expected
+
+    # Print result
+    status = '\u001b[32mOK\u001b[0m' if result == True else '\u001b[31mFailed\u001b[0m'
+    spacing = " " * (max_file_path_len - len(name) + 1)
+    print(f"{name}{spacing}{status}", flush=True)
+
+    # Return result
+    return result
+
+def test_server(file, max_file_path_len):
+    # Run a program through a server, the cache directory of the server is
+    # used and not the one of the client, which shows it did the compiling
+    name = file + ' (server)'
+    with tempfile.TemporaryDirectory() as directory:
+        socket_path = os.path.join(directory, 'socket')
+        server_cache = os.path.join(directory, 'server_cache')
+        client_cache = os.path.join(directory, 'client_cache')
+        server = subprocess.Popen([get_command(), 'server', socket_path], env=dict(os.environ, DIAMOND_CACHE_DIR=server_cache))
+
+        try:
+            for _ in range(100):
+                if os.path.exists(socket_path): break
+                time.sleep(0.1)
+
+            with open(file, encoding=os.device_encoding(1)) as content:
+                expected = re.search("(?<=--- Output\n)(.|\n)*(?=---)", content.read()).group(0)
+            environment = dict(os.environ, DIAMOND_SERVER=socket_path, DIAMOND_CACHE_DIR=client_cache)
+            run = subprocess.run([get_command(), 'run', file], stdout=subprocess.PIPE, text=True, encoding=os.device_encoding(1), env=environment)
+            result = run.stdout == expected and os.path.isdir(server_cache) and not os.path.exists(client_cache)
+
+        finally:
+            server.terminate()
+            server.wait()
+
+    # Print result
+    status = '\u001b[32mOK\u001b[0m' if result == True else '\u001b[31mFailed\u001b[0m'
+    spacing = " " * (max_file_path_len - len(name) + 1)
+    print(f"{name}{spacing}{status}", flush=True)
+
+    # Return result
+    return result
+
+def read_file_and_test(file, max_file_path_len, check_cache=False, run_options=[]):
     with open(file, encoding=os.device_encoding(1)) as content:
         content = content.read()
 
         try:
             expected = re.search("(?<=--- Output\n)(.|\n)*(?=---)", content).group(0)
-            return test(file, expected, max_file_path_len)
+            if check_cache: return test_cache(file, max_file_path_len)
+            return test(file, expected, max_file_path_len, run_options)
         
         except:
             return True
@@ -73,7 +186,19 @@ def read_file_and_test(file, max_file_path_len):
 def main():
     folder = 'test'
 
-    if len(sys.argv) > 2:
+    # With --cache the llvm ir emitted with and without the module cache is
+    # compared instead of the output of the programs, and a program run with
+    # --target-cpu=native is checked to be cached for the cpu of this machine
+    arguments = sys.argv[1:]
+    check_cache = '--cache' in arguments
+    if check_cache:
+        arguments.remove('--cache')
+
+    # --jit and the optimization levels are passed on to `diamond run`
+    run_options = [argument for argument in arguments if argument in ['--jit', '-O0', '-O1', '-O2', '-O3', '-Os']]
+    arguments = [argument for argument in arguments if argument not in run_options]
+
+    if len(arguments) > 1:
         print("Too many arguments :/")
         return sys.exit(1)
 
@@ -81,8 +206,8 @@ def main():
         print("diamond not found :(")
         return sys.exit(1)
 
-    if len(sys.argv) > 1:
-        folder = sys.argv[1]
+    if len(arguments) > 0:
+        folder = arguments[0]
 
     if os.path.isdir(folder):
         file_paths = get_all_files(folder)
@@ -90,14 +215,28 @@ def main():
 
         num_cores = multiprocessing.cpu_count()
         with multiprocessing.Pool(num_cores) as pool:
-            results = pool.map(functools.partial(read_file_and_test, max_file_path_len=max_file_path_len), file_paths)
+            results = pool.map(functools.partial(read_file_and_test, max_file_path_len=max_file_path_len, check_cache=check_cache, run_options=run_options), file_paths)
     
             for result in results:
                 if result == False:
                     sys.exit(1)
 
     else:
-        read_file_and_test(folder, get_max_path_len([folder]))
+        read_file_and_test(folder, get_max_path_len([folder]), check_cache, run_options)
+
+    if check_cache:
+        file = os.path.join('test', 'functions', 'functions1.dmd')
+        if not test_native_target(file, get_max_path_len([file + ' (native target)'])):
+            sys.exit(1)
+
+    # Batch builds and the server are checked when running all the tests
+    if len(arguments) == 0 and not check_cache and len(run_options) == 0:
+        if not test_batch(get_max_path_len(['build --batch'])):
+            sys.exit(1)
+
+        file = os.path.join('test', 'functions', 'functions1.dmd')
+        if platform.system() != 'Windows' and not test_server(file, get_max_path_len([file + ' (server)'])):
+            sys.exit(1)
 
 if __name__ == "__main__":
     main()
\ No newline at end of file